@@ -48,6 +48,11 @@
 #define SZ_NN_OPTION_MASK 32
 #define SZ_RAW_OPTION_MASK 128
 
+/* libaec extension: code groups of scanlines on one thread per
+ * processor. The environment variable SZ_THREADS overrides the
+ * number of threads, with or without this option. */
+#define SZ_THREADS_OPTION_MASK 256
+
 #define SZ_OK AEC_OK
 #define SZ_OUTBUFF_FULL 2
 
@@ -77,6 +82,37 @@ LIBAEC_DLL_EXPORTED int SZ_BufftoBuffDecompress(
     const void *source, size_t sourceLen,
     SZ_com_t *param);
 
+/* libaec extension: streaming versions of the above for data which
+ * does not fit in memory. SZ_Stream*Init() set up strm for param.
+ * Then pass input with next_in / avail_in and room for output with
+ * next_out / avail_out as for aec_encode() and aec_decode(), in as
+ * many calls as needed. Set finish for the last input to
+ * SZ_StreamCompress() and call it again until all output has been
+ * written. The compressed stream is identical to the one from
+ * SZ_BufftoBuffCompress(). The decoder outputs the last scanline
+ * in full, so stop providing output space at the original length.
+ * 32 and 64 bit pixels are not supported because their byte planes
+ * span the whole buffer. */
+LIBAEC_DLL_EXPORTED int SZ_StreamCompressInit(struct aec_stream *strm,
+                                              SZ_com_t *param);
+LIBAEC_DLL_EXPORTED int SZ_StreamCompress(struct aec_stream *strm,
+                                          int finish);
+LIBAEC_DLL_EXPORTED int SZ_StreamCompressEnd(struct aec_stream *strm);
+LIBAEC_DLL_EXPORTED int SZ_StreamDecompressInit(struct aec_stream *strm,
+                                                SZ_com_t *param);
+LIBAEC_DLL_EXPORTED int SZ_StreamDecompress(struct aec_stream *strm);
+LIBAEC_DLL_EXPORTED int SZ_StreamDecompressEnd(struct aec_stream *strm);
+
 LIBAEC_DLL_EXPORTED int SZ_encoder_enabled(void);
 
+/* libaec extension: SZ_BufftoBuffCompress() and
+ * SZ_BufftoBuffDecompress() keep their coder state for the next
+ * call with the same parameters on the same thread. Free the state
+ * of the calling thread. This also happens when a thread exits.
+ * With GCC compatible compilers the library stops doing so when it
+ * is unloaded, leaking the states of other threads. Without such a
+ * compiler, a library loaded with dlopen() must not be unloaded
+ * while threads which called it are still running. */
+LIBAEC_DLL_EXPORTED void SZ_release_cache(void);
+
 #endif /* SZLIB_H */
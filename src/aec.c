@@ -35,13 +35,40 @@
  *
  */
 
+#include "config.h"
+#include "uring.h"
 #include <libaec.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if HAVE_POSIX_FALLOCATE
+#include <fcntl.h>
+#endif
+#endif
 
 #define CHUNK 10485760
 
+/* Exit status if the output file cannot be written */
+#define WRITE_ERROR 99
+
 int get_param(unsigned int *param, int *iarg, char *argv[])
 {
     if (strlen(argv[*iarg]) == 2) {
@@ -61,32 +88,697 @@ void usage(void)
     fprintf(stderr, "NAME\n\taec - encode or decode files ");
     fprintf(stderr, "with Adaptive Entropy Coding\n\n");
     fprintf(stderr, "SYNOPSIS\n\taec [OPTION]... SOURCE DEST\n");
+    fprintf(stderr, "\taec --bench[=RUNS] [OPTION]... SOURCE\n");
     fprintf(stderr, "\nOPTIONS\n");
     fprintf(stderr, "\t-3\n\t\t24 bit samples are stored in 3 bytes\n");
     fprintf(stderr, "\t-N\n\t\tdisable pre/post processing\n");
     fprintf(stderr, "\t-b size\n\t\tinternal buffer size in bytes\n");
     fprintf(stderr, "\t-d\n\t\tdecode SOURCE. If -d is not used: encode.\n");
+    fprintf(stderr, "\t-D\n\t\tdirect I/O with io_uring if possible\n");
     fprintf(stderr, "\t-j samples\n\t\tblock size in samples\n");
     fprintf(stderr, "\t-m\n\t\tsamples are MSB first. Default is LSB\n");
     fprintf(stderr, "\t-n bits\n\t\tbits per sample\n");
     fprintf(stderr, "\t-p\n\t\tpad RSI to byte boundary\n");
     fprintf(stderr, "\t-r blocks\n\t\treference sample interval in blocks\n");
     fprintf(stderr, "\t-s\n\t\tsamples are signed. Default is unsigned\n");
-    fprintf(stderr, "\t-t\n\t\tuse restricted set of code options\n\n");
+    fprintf(stderr, "\t-t\n\t\tuse restricted set of code options\n");
+    fprintf(stderr, "\t-T threads\n\t\tcode on up to threads threads, ");
+    fprintf(stderr, "0 for one per processor\n");
+    fprintf(stderr, "\t--bench[=RUNS]\n\t\tencode and decode SOURCE ");
+    fprintf(stderr, "in memory RUNS times (10)\n\t\tand report ");
+    fprintf(stderr, "median throughput\n");
+    fprintf(stderr, "\t--stats\n\t\tprint statistics of the code ");
+    fprintf(stderr, "options in the coded data\n\n");
+}
+
+static size_t sample_bytes(const struct aec_stream *strm)
+{
+    /* Storage size of a sample */
+    if (strm->bits_per_sample > 16)
+        return strm->bits_per_sample <= 24 && strm->flags & AEC_DATA_3BYTE
+            ? 3 : 4;
+    return strm->bits_per_sample > 8 ? 2 : 1;
+}
+
+static size_t encode_bound(struct aec_stream *strm, size_t len)
+{
+    /* Every block coded uncompressed with the longest option ID,
+     * plus RSI padding and the last byte. */
+    size_t blocks = len / sample_bytes(strm) / strm->block_size + 1;
+
+    return blocks * (5 + strm->block_size * strm->bits_per_sample) / 8
+        + blocks / strm->rsi + 2 * blocks / 8 + 16;
+}
+
+static int write_output(const unsigned char *buf, size_t len, FILE *fp)
+{
+    if (len > 0 && fwrite(buf, len, 1, fp) != 1) {
+        fprintf(stderr, "ERROR: cannot write output: %s\n",
+                strerror(errno));
+        return WRITE_ERROR;
+    }
+    return AEC_OK;
+}
+
+static int code_stdio(struct aec_stream *strm, int dflag,
+                      FILE *infp, FILE *outfp,
+                      unsigned char *in, unsigned char *out, size_t chunk)
+{
+    /* Read the input in chunks through stdio */
+    size_t total_out = 0;
+    int input_avail = 1;
+    int output_avail = 1;
+    int status;
+
+    strm->avail_in = 0;
+    strm->avail_out = chunk;
+    strm->next_out = out;
+
+    while(input_avail || output_avail) {
+        if (strm->avail_in == 0 && input_avail) {
+            strm->avail_in = fread(in, 1, chunk, infp);
+            if (strm->avail_in != chunk)
+                input_avail = 0;
+            strm->next_in = in;
+        }
+
+        if (dflag)
+            status = aec_decode(strm, AEC_NO_FLUSH);
+        else
+            status = aec_encode(strm, AEC_NO_FLUSH);
+
+        if (status != AEC_OK) {
+            fprintf(stderr, "ERROR: %i\n", status);
+            return status;
+        }
+
+        if (strm->total_out - total_out > 0) {
+            status = write_output(out, strm->total_out - total_out, outfp);
+            if (status != AEC_OK)
+                return status;
+            total_out = strm->total_out;
+            output_avail = 1;
+            strm->next_out = out;
+            strm->avail_out = chunk;
+        } else {
+            output_avail = 0;
+        }
+
+    }
+
+    if (!dflag) {
+        if ((status = aec_encode(strm, AEC_FLUSH)) != AEC_OK) {
+            fprintf(stderr, "ERROR: while flushing output (%i)\n", status);
+            return status;
+        }
+
+        return write_output(out, strm->total_out - total_out, outfp);
+    }
+    return AEC_OK;
+}
+
+#if HAVE_PTHREAD
+/* Buffers passed between the reader, the coder and the writer */
+#define NBUF 2
+
+struct ring {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char *buf[NBUF];
+    size_t len[NBUF];
+    /* slots ready for the consumer */
+    int filled;
+    /* next slot for the producer and the consumer */
+    int head;
+    int tail;
+    /* producer is done */
+    int done;
+    /* consumer gave up */
+    int abort;
+};
+
+static int ring_acquire_empty(struct ring *r)
+{
+    int slot;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->filled == NBUF && !r->abort)
+        pthread_cond_wait(&r->cond, &r->lock);
+    slot = r->abort ? -1 : r->head;
+    pthread_mutex_unlock(&r->lock);
+    return slot;
+}
+
+static void ring_commit(struct ring *r, size_t len)
+{
+    pthread_mutex_lock(&r->lock);
+    r->len[r->head] = len;
+    r->head = (r->head + 1) % NBUF;
+    r->filled++;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void ring_finish(struct ring *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->done = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int ring_acquire_full(struct ring *r)
+{
+    int slot;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->filled == 0 && !r->done)
+        pthread_cond_wait(&r->cond, &r->lock);
+    slot = r->filled ? r->tail : -1;
+    pthread_mutex_unlock(&r->lock);
+    return slot;
+}
+
+static void ring_release(struct ring *r, int abort)
+{
+    pthread_mutex_lock(&r->lock);
+    if (abort) {
+        r->abort = 1;
+    } else {
+        r->tail = (r->tail + 1) % NBUF;
+        r->filled--;
+    }
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+struct pipeline {
+    struct ring in;
+    struct ring out;
+    FILE *infp;
+    FILE *outfp;
+    size_t chunk;
+    /* errno of a failed write */
+    int write_error;
+};
+
+static void *reader(void *arg)
+{
+    struct pipeline *p = arg;
+    int slot;
+
+    while ((slot = ring_acquire_empty(&p->in)) >= 0) {
+        size_t n = fread(p->in.buf[slot], 1, p->chunk, p->infp);
+        ring_commit(&p->in, n);
+        if (n != p->chunk)
+            break;
+    }
+    ring_finish(&p->in);
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    struct pipeline *p = arg;
+    int slot;
+
+    while ((slot = ring_acquire_full(&p->out)) >= 0) {
+        if (fwrite(p->out.buf[slot], p->out.len[slot], 1, p->outfp) != 1) {
+            p->write_error = errno ? errno : EIO;
+            ring_release(&p->out, 1);
+            break;
+        }
+        ring_release(&p->out, 0);
+    }
+    return NULL;
+}
+
+static int code_slot(struct aec_stream *strm, int dflag, int flush,
+                     struct pipeline *p, int *out_slot)
+{
+    /* Code until the coder stops filling output slots */
+    int status;
+
+    do {
+        size_t n;
+
+        if (*out_slot < 0) {
+            *out_slot = ring_acquire_empty(&p->out);
+            if (*out_slot < 0)
+                return WRITE_ERROR;
+        }
+        strm->next_out = p->out.buf[*out_slot];
+        strm->avail_out = p->chunk;
+
+        if (dflag)
+            status = aec_decode(strm, flush);
+        else
+            status = aec_encode(strm, flush);
+        if (status != AEC_OK)
+            return status;
+
+        n = p->chunk - strm->avail_out;
+        if (n > 0) {
+            ring_commit(&p->out, n);
+            *out_slot = -1;
+        }
+    } while (strm->avail_out == 0);
+    return AEC_OK;
+}
+
+static int code_pipelined(struct aec_stream *strm, int dflag,
+                          FILE *infp, FILE *outfp,
+                          unsigned char *in, unsigned char *out,
+                          size_t chunk)
+{
+    /* Reading, coding and writing run on separate threads with
+     * NBUF buffers in between, so I/O overlaps with coding. */
+    struct pipeline p;
+    pthread_t read_thread, write_thread;
+    int slot;
+    int out_slot = -1;
+    int status = AEC_OK;
+
+    memset(&p, 0, sizeof(p));
+    p.infp = infp;
+    p.outfp = outfp;
+    p.chunk = chunk;
+    p.in.buf[0] = in;
+    p.out.buf[0] = out;
+    for (int i = 1; i < NBUF; i++) {
+        p.in.buf[i] = malloc(chunk);
+        p.out.buf[i] = malloc(chunk);
+        if (p.in.buf[i] == NULL || p.out.buf[i] == NULL)
+            status = 99;
+    }
+    pthread_mutex_init(&p.in.lock, NULL);
+    pthread_cond_init(&p.in.cond, NULL);
+    pthread_mutex_init(&p.out.lock, NULL);
+    pthread_cond_init(&p.out.cond, NULL);
+
+    if (status != AEC_OK)
+        goto exit;
+    /* Without threads code serially, nothing has been read or
+     * written yet */
+    if (pthread_create(&write_thread, NULL, writer, &p) != 0) {
+        status = code_stdio(strm, dflag, infp, outfp, in, out, chunk);
+        goto exit;
+    }
+    if (pthread_create(&read_thread, NULL, reader, &p) != 0) {
+        ring_finish(&p.out);
+        pthread_join(write_thread, NULL);
+        status = code_stdio(strm, dflag, infp, outfp, in, out, chunk);
+        goto exit;
+    }
+
+    while ((slot = ring_acquire_full(&p.in)) >= 0) {
+        strm->next_in = p.in.buf[slot];
+        strm->avail_in = p.in.len[slot];
+        status = code_slot(strm, dflag, AEC_NO_FLUSH, &p, &out_slot);
+        if (status != AEC_OK)
+            break;
+        ring_release(&p.in, 0);
+    }
+
+    if (status == AEC_OK && !dflag)
+        status = code_slot(strm, dflag, AEC_FLUSH, &p, &out_slot);
+
+    ring_release(&p.in, 1);
+    ring_finish(&p.out);
+    pthread_join(read_thread, NULL);
+    pthread_join(write_thread, NULL);
+
+    /* A failed write aborts the output ring, which the coder sees as
+     * a generic failure, so the writer's errno takes precedence. */
+    if (p.write_error) {
+        fprintf(stderr, "ERROR: cannot write output: %s\n",
+                strerror(p.write_error));
+        status = WRITE_ERROR;
+    } else if (status != AEC_OK) {
+        fprintf(stderr, "ERROR: %i\n", status);
+    }
+
+exit:
+    pthread_mutex_destroy(&p.in.lock);
+    pthread_cond_destroy(&p.in.cond);
+    pthread_mutex_destroy(&p.out.lock);
+    pthread_cond_destroy(&p.out.cond);
+    for (int i = 1; i < NBUF; i++) {
+        free(p.in.buf[i]);
+        free(p.out.buf[i]);
+    }
+    return status;
+}
+#endif
+
+#if HAVE_MMAP
+static unsigned char *map_file(int fd, size_t len, int prot)
+{
+    void *p = mmap(NULL, len, prot, MAP_SHARED, fd, 0);
+
+    if (p == MAP_FAILED)
+        return NULL;
+#if HAVE_MADVISE
+    madvise(p, len, MADV_SEQUENTIAL);
+#endif
+    return p;
+}
+
+static unsigned char *map_input(FILE *fp, size_t *len)
+{
+    /* Only regular files are mapped */
+    struct stat st;
+
+    if (fstat(fileno(fp), &st) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_size <= 0
+        || (uintmax_t)st.st_size > SIZE_MAX)
+        return NULL;
+
+    *len = (size_t)st.st_size;
+    return map_file(fileno(fp), *len, PROT_READ);
+}
+
+static int map_output(int fd, size_t len, unsigned char **map)
+{
+    /* Map len bytes of the empty output file for writing. The blocks
+     * are allocated first: a full disk would otherwise only show
+     * while writing through the mapping, and kill us with SIGBUS.
+     * Without a mapping the file is left empty for buffered
+     * output. */
+    struct stat st;
+
+    *map = NULL;
+#if HAVE_POSIX_FALLOCATE
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        return AEC_OK;
+    if (posix_fallocate(fd, 0, (off_t)len) == 0)
+        *map = map_file(fd, len, PROT_READ | PROT_WRITE);
+    if (*map == NULL && ftruncate(fd, 0) != 0) {
+        fprintf(stderr, "ERROR: cannot truncate output: %s\n",
+                strerror(errno));
+        return WRITE_ERROR;
+    }
+#else
+    (void)st;
+    (void)fd;
+    (void)len;
+#endif
+    return AEC_OK;
+}
+
+static int code_mapped(struct aec_stream *strm, int dflag,
+                       const unsigned char *in, size_t in_len,
+                       FILE *outfp, unsigned char *out, size_t chunk)
+{
+    /* All input is in memory. The encoder writes straight into the
+     * mapped output file if that can be set up, otherwise output
+     * goes through a buffer. */
+    int fd = fileno(outfp);
+    unsigned char *map = NULL;
+    size_t bound = 0;
+    int status;
+
+    strm->next_in = in;
+    strm->avail_in = in_len;
+
+    if (!dflag) {
+        bound = encode_bound(strm, in_len);
+        if ((status = map_output(fd, bound, &map)) != AEC_OK)
+            return status;
+    }
+
+    if (map) {
+        strm->next_out = map;
+        strm->avail_out = bound;
+        status = aec_encode(strm, AEC_FLUSH);
+        munmap(map, bound);
+        if (status != AEC_OK) {
+            fprintf(stderr, "ERROR: %i\n", status);
+        } else if (ftruncate(fd, (off_t)strm->total_out) != 0) {
+            fprintf(stderr, "ERROR: cannot truncate output: %s\n",
+                    strerror(errno));
+            status = WRITE_ERROR;
+        }
+        return status;
+    }
+
+    do {
+        strm->next_out = out;
+        strm->avail_out = chunk;
+        if (dflag)
+            status = aec_decode(strm, AEC_FLUSH);
+        else
+            status = aec_encode(strm, AEC_FLUSH);
+        if (status != AEC_OK) {
+            fprintf(stderr, "ERROR: %i\n", status);
+            return status;
+        }
+        status = write_output(out, chunk - strm->avail_out, outfp);
+    } while (status == AEC_OK && strm->avail_out == 0);
+    return status;
+}
+#endif
+
+static double seconds(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static double cycles(void)
+{
+    /* Time stamp counter, 0 where there is none */
+#ifdef HAVE_RDTSC
+    return (double)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(double), compare_double);
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static int bench_run(struct aec_stream *param, int dflag, unsigned threads,
+                     const unsigned char *src, size_t src_len,
+                     unsigned char *dest, size_t dest_len,
+                     size_t *out_len, double *t, double *c)
+{
+    /* Code src into dest once, timing everything from init to end */
+    struct aec_stream strm = *param;
+    double t0 = seconds();
+    double c0 = cycles();
+    int status;
+
+    strm.next_in = src;
+    strm.avail_in = src_len;
+    strm.next_out = dest;
+    strm.avail_out = dest_len;
+
+    if (dflag) {
+        status = aec_decode_init(&strm);
+        if (status == AEC_OK)
+            status = aec_decode_set_threads(&strm, (int)threads);
+        if (status == AEC_OK)
+            status = aec_decode(&strm, AEC_FLUSH);
+        aec_decode_end(&strm);
+    } else {
+        status = aec_encode_init(&strm);
+        if (status == AEC_OK)
+            status = aec_encode_set_threads(&strm, (int)threads);
+        if (status == AEC_OK)
+            status = aec_encode(&strm, AEC_FLUSH);
+        if (status == AEC_OK)
+            status = aec_encode_end(&strm);
+    }
+    *c = cycles() - c0;
+    *t = seconds() - t0;
+    *out_len = strm.total_out;
+    return status;
+}
+
+static int bench_pass(struct aec_stream *param, int dflag,
+                      unsigned threads, int runs,
+                      const unsigned char *in, size_t in_len,
+                      unsigned char *out, size_t out_max, size_t *out_len,
+                      double *t, double *c)
+{
+    /* Code in once for warm up and then runs times, keeping the
+     * times and cycles of the latter. */
+    int status = AEC_OK;
+
+    *out_len = 0;
+    for (int i = -1; i < runs && status == AEC_OK; i++) {
+        double ti, ci;
+        status = bench_run(param, dflag, threads, in, in_len,
+                           out, out_max, out_len, &ti, &ci);
+        if (status != AEC_OK) {
+            fprintf(stderr, "ERROR: %i\n", status);
+        } else if (i >= 0) {
+            t[i] = ti;
+            c[i] = ci;
+        }
+    }
+    return status;
+}
+
+static int bench(struct aec_stream *param, unsigned threads, int runs,
+                 const char *fn)
+{
+    /* Encode and decode the samples in fn in memory, once for warm
+     * up and then runs times. Report the medians. */
+    unsigned char *src = NULL, *rz = NULL, *dec = NULL;
+    double *t = NULL, *c = NULL;
+    size_t len, rz_max, samples;
+    size_t rz_len = 0;
+    size_t dec_len = 0;
+    int status = 99;
+    FILE *fp;
+
+    if ((fp = fopen(fn, "rb")) == NULL) {
+        fprintf(stderr, "ERROR: cannot open input file %s\n", fn);
+        return 99;
+    }
+    fseek(fp, 0L, SEEK_END);
+    len = (size_t)ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    samples = len / sample_bytes(param);
+    len = samples * sample_bytes(param);
+    rz_max = encode_bound(param, len);
+
+    src = malloc(len);
+    rz = malloc(rz_max);
+    dec = malloc(len);
+    t = malloc(2 * runs * sizeof(double));
+    c = malloc(2 * runs * sizeof(double));
+    if (src == NULL || rz == NULL || dec == NULL || t == NULL || c == NULL
+        || samples == 0 || fread(src, 1, len, fp) != len)
+        goto exit;
+
+    /* Encode first: decoding reads the encoder's output */
+    status = bench_pass(param, 0, threads, runs, src, len, rz, rz_max,
+                        &rz_len, t, c);
+    if (status == AEC_OK)
+        status = bench_pass(param, 1, threads, runs, rz, rz_len, dec, len,
+                            &dec_len, t + runs, c + runs);
+    if (status != AEC_OK)
+        goto exit;
+    if (dec_len != len || memcmp(src, dec, len)) {
+        fprintf(stderr, "ERROR: decoded data differs\n");
+        status = 99;
+        goto exit;
+    }
+
+    printf("%zu samples, %zu bytes, ratio %.3f, median of %i runs\n",
+           samples, len, (double)len / rz_len, runs);
+    for (int dflag = 0; dflag < 2; dflag++) {
+        double tm = median(t + dflag * runs, runs);
+        double cm = median(c + dflag * runs, runs);
+
+        printf("%s %10.2f MiB/s %12.4g samples/s", dflag ? "decode" : "encode",
+               len / 1048576.0 / tm, samples / tm);
+        if (cm > 0)
+            printf(" %8.3f cycles/sample", cm / samples);
+        printf("\n");
+    }
+
+exit:
+    fclose(fp);
+    free(src);
+    free(rz);
+    free(dec);
+    free(t);
+    free(c);
+    return status;
+}
+
+static void print_option(const char *name, int k, uint64_t cdss,
+                         uint64_t blocks, uint64_t bits,
+                         const struct aec_stream *strm, double coded_bits)
+{
+    /* One line of the histogram, k < 0 if there is no k */
+    if (cdss == 0)
+        return;
+    if (k < 0)
+        printf("%-8s", name);
+    else
+        printf("%-5s %2i", name, k);
+    printf(" %12" PRIu64 " %12" PRIu64 " %12.3f %7.2f%%\n", cdss, blocks,
+           (double)bits / (blocks * strm->block_size),
+           100.0 * bits / coded_bits);
+}
+
+static void print_stats(const struct aec_stream *strm,
+                        const struct aec_stats *stats, int dflag)
+{
+    /* Histogram of code options with average bits per sample and
+     * their share of the coded data */
+    double coded_bits = (dflag ? strm->total_in : strm->total_out) * 8.0;
+    uint64_t runs = 0;
+
+    for (int i = 0; i < AEC_STATS_MAX_RUN; i++)
+        runs += stats->zero_runs[i];
+
+    printf("%-8s %12s %12s %12s %8s\n",
+           "option", "CDSs", "blocks", "bits/sample", "share");
+    print_option("zero", -1, runs, stats->zero_blocks, stats->zero_bits,
+                 strm, coded_bits);
+    print_option("se", -1, stats->se_blocks, stats->se_blocks,
+                 stats->se_bits, strm, coded_bits);
+    for (int k = 0; k < AEC_STATS_MAX_K; k++)
+        print_option("split", k, stats->split_blocks[k],
+                     stats->split_blocks[k], stats->split_bits[k],
+                     strm, coded_bits);
+    print_option("uncomp", -1, stats->uncomp_blocks, stats->uncomp_blocks,
+                 stats->uncomp_bits, strm, coded_bits);
+
+    if (runs) {
+        printf("\n%-8s %12s\n", "zero run", "count");
+        for (int i = 0; i < AEC_STATS_MAX_RUN; i++)
+            if (stats->zero_runs[i])
+                printf("%-8i %12" PRIu64 "\n", i + 1, stats->zero_runs[i]);
+    }
+
+    printf("\n%-8s %12" PRIu64 " bits %7.2f%%\n", "ID",
+           stats->id_bits, 100.0 * stats->id_bits / coded_bits);
+    printf("%-8s %12" PRIu64 " bits %7.2f%%\n", "ref",
+           stats->ref_bits, 100.0 * stats->ref_bits / coded_bits);
+    printf("%-8s %12" PRIu64 "\n", "RSIs", stats->rsis);
 }
 
 int main(int argc, char *argv[])
 {
     struct aec_stream strm;
+    struct aec_stats stats;
     unsigned char *in = NULL;
     unsigned char *out = NULL;
-    size_t total_out;
+    unsigned char *in_map = NULL;
+    size_t in_len = 0;
     unsigned int chunk;
+    unsigned int threads = 1;
     int status = 0;
-    int input_avail, output_avail;
     char *infn, *outfn;
     FILE *infp, *outfp;
     int dflag;
+    int direct = 0;
+    int bench_runs = 0;
+    int sflag = 0;
+    int files = 2;
     char *opt;
     int iarg;
 
@@ -96,9 +788,14 @@ int main(int argc, char *argv[])
     strm.rsi = 2;
     strm.flags = AEC_DATA_PREPROCESS;
     dflag = 0;
-    iarg = 1;
 
-    while (iarg < argc - 2) {
+    /* Benchmarks only need a source */
+    for (iarg = 1; iarg < argc - 1; iarg++)
+        if (strncmp(argv[iarg], "--bench", 7) == 0)
+            files = 1;
+
+    iarg = 1;
+    while (iarg < argc - files) {
         opt = argv[iarg];
         if (opt[0] != '-') {
             usage();
@@ -120,6 +817,9 @@ int main(int argc, char *argv[])
         case 'd':
             dflag = 1;
             break;
+        case 'D':
+            direct = 1;
+            break;
         case 'j':
             if (get_param(&strm.block_size, &iarg, argv)) {
                 usage();
@@ -150,6 +850,25 @@ int main(int argc, char *argv[])
         case 't':
             strm.flags |= AEC_RESTRICTED;
             break;
+        case 'T':
+            if (get_param(&threads, &iarg, argv)) {
+                usage();
+                goto DESTRUCT;
+            }
+            break;
+        case '-':
+            if (strcmp(opt, "--bench") == 0) {
+                bench_runs = 10;
+            } else if (strncmp(opt, "--bench=", 8) == 0
+                       && atoi(opt + 8) > 0) {
+                bench_runs = atoi(opt + 8);
+            } else if (strcmp(opt, "--stats") == 0) {
+                sflag = 1;
+            } else {
+                usage();
+                goto DESTRUCT;
+            }
+            break;
         default:
             usage();
             goto DESTRUCT;
@@ -157,108 +876,118 @@ int main(int argc, char *argv[])
         iarg++;
     }
 
-    if (argc - iarg < 2) {
+    if (argc - iarg < files || (sflag && bench_runs)) {
         usage();
         goto DESTRUCT;
     }
 
-    infn = argv[iarg];
-    outfn = argv[iarg + 1];
-
-    if (strm.bits_per_sample > 16) {
-        if (strm.bits_per_sample <= 24 && strm.flags & AEC_DATA_3BYTE)
-            chunk *= 3;
-        else
-            chunk *= 4;
-    } else if (strm.bits_per_sample > 8) {
-        chunk *= 2;
-    }
-
-    out = (unsigned char *)malloc(chunk);
-    in = (unsigned char *)malloc(chunk);
-
-    if (in == NULL || out == NULL) {
-        status = 99;
+    if (bench_runs) {
+        status = bench(&strm, threads, bench_runs, argv[iarg]);
         goto DESTRUCT;
     }
 
-    total_out = 0;
-    strm.avail_in = 0;
-    strm.avail_out = chunk;
-    strm.next_out = out;
+    infn = argv[iarg];
+    outfn = argv[iarg + 1];
 
-    input_avail = 1;
-    output_avail = 1;
+    chunk *= (unsigned int)sample_bytes(&strm);
 
     if ((infp = fopen(infn, "rb")) == NULL) {
         fprintf(stderr, "ERROR: cannot open input file %s\n", infn);
         status = 99;
         goto DESTRUCT;
     }
-    if ((outfp = fopen(outfn, "wb")) == NULL) {
+    if ((outfp = fopen(outfn, "w+b")) == NULL) {
         fprintf(stderr, "ERROR: cannot open output file %s\n", infn);
         status = 99;
         goto DESTRUCT;
     }
 
-    if (dflag)
+#if HAVE_MMAP
+    if (!direct)
+        in_map = map_input(infp, &in_len);
+#endif
+
+    out = (unsigned char *)malloc(chunk);
+    if (in_map == NULL)
+        in = (unsigned char *)malloc(chunk);
+
+    if ((in_map == NULL && in == NULL) || out == NULL) {
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    if (dflag) {
         status = aec_decode_init(&strm);
-    else
+        if (status == AEC_OK)
+            status = aec_decode_set_threads(&strm, (int)threads);
+        if (status == AEC_OK && sflag)
+            status = aec_decode_set_stats(&strm, &stats);
+    } else {
         status = aec_encode_init(&strm);
+        if (status == AEC_OK)
+            status = aec_encode_set_threads(&strm, (int)threads);
+        if (status == AEC_OK && sflag)
+            status = aec_encode_set_stats(&strm, &stats);
+    }
 
     if (status != AEC_OK) {
         fprintf(stderr, "ERROR: initialization failed (%d)\n", status);
         goto DESTRUCT;
     }
 
-    while(input_avail || output_avail) {
-        if (strm.avail_in == 0 && input_avail) {
-            strm.avail_in = fread(in, 1, chunk, infp);
-            if (strm.avail_in != chunk)
-                input_avail = 0;
-            strm.next_in = in;
-        }
-
-        if (dflag)
-            status = aec_decode(&strm, AEC_NO_FLUSH);
-        else
-            status = aec_encode(&strm, AEC_NO_FLUSH);
-
-        if (status != AEC_OK) {
+    if (direct) {
+        status = uring_code(&strm, dflag, infn, outfn, chunk,
+                            sample_bytes(&strm));
+        if (status != AEC_OK && status != URING_UNAVAILABLE)
             fprintf(stderr, "ERROR: %i\n", status);
-            goto DESTRUCT;
-        }
-
-        if (strm.total_out - total_out > 0) {
-            fwrite(out, strm.total_out - total_out, 1, outfp);
-            total_out = strm.total_out;
-            output_avail = 1;
-            strm.next_out = out;
-            strm.avail_out = chunk;
-        } else {
-            output_avail = 0;
-        }
+    } else {
+        status = URING_UNAVAILABLE;
+    }
 
+    if (status == URING_UNAVAILABLE) {
+#if HAVE_MMAP
+        /* Code as without -D, which skipped mapping the input */
+        if (direct)
+            in_map = map_input(infp, &in_len);
+        if (in_map)
+            status = code_mapped(&strm, dflag, in_map, in_len,
+                                 outfp, out, chunk);
+        else
+#endif
+#if HAVE_PTHREAD
+            status = code_pipelined(&strm, dflag, infp, outfp,
+                                    in, out, chunk);
+#else
+            status = code_stdio(&strm, dflag, infp, outfp, in, out, chunk);
+#endif
     }
 
     if (dflag) {
         aec_decode_end(&strm);
     } else {
-        if ((status = aec_encode(&strm, AEC_FLUSH)) != AEC_OK) {
-            fprintf(stderr, "ERROR: while flushing output (%i)\n", status);
-            goto DESTRUCT;
-        }
-
-        if (strm.total_out - total_out > 0)
-            fwrite(out, strm.total_out - total_out, 1, outfp);
-
-        aec_encode_end(&strm);
+        int end_status = aec_encode_end(&strm);
+        if (status == AEC_OK)
+            status = end_status;
     }
+    if (status != AEC_OK)
+        goto DESTRUCT;
+
+    if (sflag)
+        print_stats(&strm, &stats, dflag);
 
     fclose(infp);
-    fclose(outfp);
+    /* Buffered output may only fail to be written now */
+    if (fclose(outfp) != 0) {
+        fprintf(stderr, "ERROR: cannot write output: %s\n",
+                strerror(errno));
+        status = WRITE_ERROR;
+    }
 
 DESTRUCT:
+#if HAVE_MMAP
+    if (in_map)
+        munmap(in_map, in_len);
+#endif
     if (in)
         free(in);
     if (out)
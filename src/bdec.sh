@@ -6,7 +6,10 @@ if [ ! -f bench.rz ]; then
 fi
 rm -f dec.dat
 bsize=$(wc -c bench.dat | awk '{print $1}')
-utime=$(./utime ./aec -d -n16 -j64 -r256 -m bench.rz dec.dat 2>&1)
+./utime ./aec -d -n16 -j64 -r256 -m bench.rz dec.dat 2> bench.time
+cat bench.time
+utime=$(awk '$1 == "user" {print $2}' bench.time)
+rm -f bench.time
 perf=$(awk "BEGIN {print ${bsize}/1048576/${utime}}")
 echo "[0;32m*** Decoding with $perf MiB/s user time ***[0m"
 cmp bench.dat dec.dat
@@ -12,8 +12,10 @@ if [ ! -f  bench.dat ]; then
     rm -f typical.dat
 fi
 rm -f bench.rz
-utime=$(./utime $AEC -n16 -j64 -r256 -m bench.dat bench.rz 2>&1)
-echo $utime
+./utime $AEC -n16 -j64 -r256 -m bench.dat bench.rz 2> bench.time
+cat bench.time
+utime=$(awk '$1 == "user" {print $2}' bench.time)
+rm -f bench.time
 bsize=$(wc -c bench.dat | awk '{print $1}')
 perf=$(awk "BEGIN {print ${bsize}/1048576/${utime}}")
 echo "[0;32m*** Encoding with $perf MiB/s user time ***[0m"
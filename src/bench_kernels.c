@@ -0,0 +1,386 @@
+/**
+ * @file bench_kernels.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Throughput of the encoder and decoder kernels on synthetic
+ * samples. The differences between consecutive samples follow a
+ * discrete Laplace distribution whose preprocessed values have a
+ * given mean, so the entropy of the input and with it the code
+ * option and k are under control. Every kernel runs over all
+ * samples several times and the median time per sample is
+ * reported.
+ *
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include "config.h"
+#include "bench_kernels.h"
+#include "libaec.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct bitwriter {
+    unsigned char *p;
+    uint64_t acc;
+    int bits;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *t, int n)
+{
+    qsort(t, n, sizeof(double), cmp_double);
+    return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+static uint64_t rng_state = UINT64_C(0x9e3779b97f4a7c15);
+
+static double uniform(void)
+{
+    /* xorshift64*, uniform in (0, 1) */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * UINT64_C(2685821657736338717) >> 11) + 0.5)
+        / 9007199254740992.0;
+}
+
+static int64_t laplace(double mean)
+{
+    /* Difference whose preprocessed value 2|D| or 2|D| - 1 has
+     * about the given mean */
+    int64_t m;
+
+    if (mean <= 0)
+        return 0;
+    m = (int64_t)(log(uniform()) / log(1 - 2 / (mean + 2)));
+    return uniform() < 0.5 ? -m : m;
+}
+
+static void generate(struct bench_data *d, double mean)
+{
+    /**
+       Random walk with Laplace distributed steps, reflected at the
+       limits of the sample range.
+    */
+
+    size_t size = d->raw_len / d->samples;
+    int msb = d->flags & AEC_DATA_MSB;
+    int64_t lo, hi, x;
+
+    if (d->flags & AEC_DATA_SIGNED) {
+        hi = (INT64_C(1) << (d->bits_per_sample - 1)) - 1;
+        lo = -hi - 1;
+    } else {
+        hi = (INT64_C(1) << d->bits_per_sample) - 1;
+        lo = 0;
+    }
+    x = lo + (hi - lo) / 2;
+
+    for (size_t i = 0; i < d->samples; i++) {
+        uint32_t u;
+
+        x += laplace(mean);
+        while (x < lo || x > hi) {
+            if (x > hi)
+                x = 2 * hi - x;
+            else
+                x = 2 * lo - x;
+        }
+        u = (uint32_t)x & (UINT32_MAX >> (32 - d->bits_per_sample));
+        for (size_t j = 0; j < size; j++) {
+            size_t b = msb ? size - 1 - j : j;
+            d->raw[i * size + b] = (unsigned char)(u >> (8 * j));
+        }
+    }
+}
+
+static void put_bits(struct bitwriter *w, uint32_t data, int n)
+{
+    if (n == 0)
+        return;
+    w->acc = (w->acc << n) | (data & (UINT64_MAX >> (64 - n)));
+    w->bits += n;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        *w->p++ = (unsigned char)(w->acc >> w->bits);
+    }
+}
+
+static void put_fs(struct bitwriter *w, uint64_t fs)
+{
+    for (; fs >= 32; fs -= 32)
+        put_bits(w, 0, 32);
+    put_bits(w, 1, (int)fs + 1);
+}
+
+static size_t end_bits(struct bitwriter *w, unsigned char *start)
+{
+    put_bits(w, 0, 7);
+    memset(w->p, 0, BENCH_PAD);
+    return (size_t)(w->p - start);
+}
+
+static void se_pair(uint32_t *a, uint32_t *b)
+{
+    /* Scale a pair down until the second extension can code it */
+    while ((uint64_t)*a + *b > 12) {
+        *a /= 2;
+        *b /= 2;
+    }
+}
+
+static int make_streams(struct bench_data *d)
+{
+    /**
+       Code the preprocessed samples with the best fixed k and with
+       the second extension option.
+    */
+
+    uint64_t best = UINT64_MAX;
+    uint64_t se_bits = 0;
+    struct bitwriter w;
+
+    for (int k = 0; k < (int)d->bits_per_sample; k++) {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < d->samples; i++)
+            bits += (d->mapped[i] >> k) + 1 + k;
+        if (bits < best) {
+            best = bits;
+            d->k = k;
+        }
+    }
+    for (size_t i = 0; i < d->samples; i += 2) {
+        uint32_t a = d->mapped[i], b = d->mapped[i + 1];
+        se_pair(&a, &b);
+        se_bits += (uint64_t)(a + b) * (a + b + 1) / 2 + b + 1;
+    }
+
+    d->split = malloc(best / 8 + 8 + BENCH_PAD);
+    d->fs = malloc(best / 8 + 8 + BENCH_PAD);
+    d->se = malloc(se_bits / 8 + 8 + BENCH_PAD);
+    if (d->split == NULL || d->fs == NULL || d->se == NULL)
+        return -1;
+
+    memset(&w, 0, sizeof(w));
+    w.p = d->split;
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        for (size_t j = i; j < i + d->block_size; j++)
+            put_fs(&w, d->mapped[j] >> d->k);
+        for (size_t j = i; j < i + d->block_size; j++)
+            put_bits(&w, d->mapped[j], d->k);
+    }
+    d->split_len = end_bits(&w, d->split);
+
+    memset(&w, 0, sizeof(w));
+    w.p = d->fs;
+    for (size_t i = 0; i < d->samples; i++)
+        put_fs(&w, d->mapped[i] >> d->k);
+    d->fs_len = end_bits(&w, d->fs);
+
+    memset(&w, 0, sizeof(w));
+    w.p = d->se;
+    for (size_t i = 0; i < d->samples; i += 2) {
+        uint32_t a = d->mapped[i], b = d->mapped[i + 1];
+        se_pair(&a, &b);
+        put_fs(&w, (uint64_t)(a + b) * (a + b + 1) / 2 + b);
+    }
+    d->se_len = end_bits(&w, d->se);
+    return 0;
+}
+
+static int selected(const char *name, int argc, char *argv[], int first)
+{
+    if (first == argc)
+        return 1;
+    for (int i = first; i < argc; i++)
+        if (strcmp(name, argv[i]) == 0)
+            return 1;
+    return 0;
+}
+
+static int run(const struct bench_kernel *kernels, struct bench_data *d,
+               double *t, int reps, int argc, char *argv[], int first)
+{
+    for (const struct bench_kernel *kn = kernels; kn->name; kn++) {
+        size_t n = 0;
+
+        if (!selected(kn->name, argc, argv, first))
+            continue;
+        /* Warm up */
+        if (kn->run(d) == 0) {
+            fprintf(stderr, "%s failed\n", kn->name);
+            return -1;
+        }
+        for (int r = 0; r < reps; r++) {
+            double t0 = now();
+            n = kn->run(d);
+            t[r] = now() - t0;
+        }
+        printf("%-24s %10.3f %12.1f\n", kn->name,
+               median(t, reps) * 1e9 / n, n / median(t, reps) * 1e-6);
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [OPTION]... [KERNEL]...\n", name);
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -n BITS  bits per sample (default 16)\n");
+    fprintf(stderr, "  -j SIZE  samples per block (default 16)\n");
+    fprintf(stderr, "  -r RSI   blocks per RSI (default 128)\n");
+    fprintf(stderr, "  -e MEAN  mean of preprocessed samples (default 8)\n");
+    fprintf(stderr, "  -S N     samples (default 1048576)\n");
+    fprintf(stderr, "  -R N     repetitions (default 11)\n");
+    fprintf(stderr, "  -s       samples are signed\n");
+    fprintf(stderr, "  -m       samples are MSB first\n");
+    fprintf(stderr, "\nKernels:\n ");
+    for (const struct bench_kernel *k = bench_encode_kernels; k->name; k++)
+        fprintf(stderr, " %s", k->name);
+    fprintf(stderr, "\n ");
+    for (const struct bench_kernel *k = bench_decode_kernels; k->name; k++)
+        fprintf(stderr, " %s", k->name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_data d;
+    double *t = NULL;
+    double mean = 8;
+    size_t samples = 1 << 20;
+    size_t n;
+    int reps = 11;
+    int status = 1;
+    int opt;
+
+    memset(&d, 0, sizeof(d));
+    d.bits_per_sample = 16;
+    d.block_size = 16;
+    d.rsi = 128;
+    d.flags = AEC_DATA_PREPROCESS;
+
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        char o = argv[opt][1];
+        if (o == 's') {
+            d.flags |= AEC_DATA_SIGNED;
+        } else if (o == 'm') {
+            d.flags |= AEC_DATA_MSB;
+        } else if (o && strchr("njreSR", o) && opt + 1 < argc) {
+            const char *v = argv[++opt];
+            if (o == 'n')
+                d.bits_per_sample = atoi(v);
+            else if (o == 'j')
+                d.block_size = atoi(v);
+            else if (o == 'r')
+                d.rsi = atoi(v);
+            else if (o == 'e')
+                mean = atof(v);
+            else if (o == 'S')
+                samples = (size_t)atol(v);
+            else
+                reps = atoi(v);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1 || d.bits_per_sample < 1 || d.bits_per_sample > 32
+        || d.block_size == 0 || d.rsi == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    n = d.rsi * d.block_size;
+    d.samples = (samples + n - 1) / n * n;
+    d.raw_len = d.samples * (d.bits_per_sample > 16 ? 4
+                             : d.bits_per_sample > 8 ? 2 : 1);
+    d.raw = malloc(d.raw_len);
+    d.mapped = malloc(d.samples * sizeof(uint32_t));
+    d.out_len = d.samples * 5 + 8 + BENCH_PAD;
+    d.out = malloc(d.out_len);
+    t = malloc(reps * sizeof(double));
+    if (d.raw == NULL || d.mapped == NULL || d.out == NULL || t == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        goto DESTRUCT;
+    }
+
+    generate(&d, mean);
+    if (bench_encode_setup(&d)) {
+        fprintf(stderr, "Encoder initialization failed\n");
+        goto DESTRUCT;
+    }
+    if (make_streams(&d)) {
+        fprintf(stderr, "Not enough memory\n");
+        goto END_ENCODE;
+    }
+    if (bench_decode_setup(&d)) {
+        fprintf(stderr, "Decoder initialization failed\n");
+        goto END_ENCODE;
+    }
+
+    printf("%u bit, block %u, rsi %u, mean %g, k %i, %zu samples\n",
+           d.bits_per_sample, d.block_size, d.rsi, mean, d.k, d.samples);
+    printf("%-24s %10s %12s\n", "kernel", "ns/sample", "Msamples/s");
+    if (run(bench_encode_kernels, &d, t, reps, argc, argv, opt) == 0
+        && run(bench_decode_kernels, &d, t, reps, argc, argv, opt) == 0)
+        status = 0;
+
+    bench_decode_end();
+END_ENCODE:
+    bench_encode_end();
+DESTRUCT:
+    free(d.raw);
+    free(d.mapped);
+    free(d.out);
+    free(d.split);
+    free(d.fs);
+    free(d.se);
+    free(t);
+    return status;
+}
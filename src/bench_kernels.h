@@ -0,0 +1,103 @@
+/**
+ * @file bench_kernels.h
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Interface between the kernel benchmark and the wrappers which
+ * compile the encoder and decoder with their static functions.
+ *
+ */
+
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Zero bytes behind the bit streams so the fast paths never run
+ * out of input */
+#define BENCH_PAD 1024
+
+struct bench_data {
+    unsigned int bits_per_sample;
+    unsigned int block_size;
+    unsigned int rsi;
+    unsigned int flags;
+
+    /* multiple of rsi * block_size */
+    size_t samples;
+
+    /* samples in storage format */
+    unsigned char *raw;
+    size_t raw_len;
+
+    /* preprocessed samples, filled by bench_encode_setup() */
+    uint32_t *mapped;
+
+    /* splitting position of split and fs */
+    int k;
+
+    /* split option CDSs of all blocks without ID */
+    unsigned char *split;
+    size_t split_len;
+
+    /* only the fundamental sequences of split */
+    unsigned char *fs;
+    size_t fs_len;
+
+    /* second extension CDSs of all blocks without ID. The
+     * samples are clamped to the range of the option. */
+    unsigned char *se;
+    size_t se_len;
+
+    /* output large enough for every kernel */
+    unsigned char *out;
+    size_t out_len;
+};
+
+struct bench_kernel {
+    const char *name;
+
+    /* One pass over the data. Returns the number of samples
+     * processed or 0 on error. */
+    size_t (*run)(struct bench_data *d);
+};
+
+int bench_encode_setup(struct bench_data *d);
+void bench_encode_end(void);
+int bench_decode_setup(struct bench_data *d);
+void bench_decode_end(void);
+
+/* Terminated by an entry with name NULL */
+extern const struct bench_kernel bench_encode_kernels[];
+extern const struct bench_kernel bench_decode_kernels[];
+
+#endif /* BENCH_KERNELS_H */
@@ -0,0 +1,161 @@
+/**
+ * @file bench_kernels_dec.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Decoder kernels for the kernel benchmark. The decoder is
+ * compiled into this file so its static functions can be called
+ * one at a time on a stream set up by aec_decode_init().
+ *
+ */
+
+#include "decode.c"
+#include "bench_kernels.h"
+
+static struct aec_stream strm;
+
+/* Keeps results of pure functions alive */
+static volatile uint32_t sink;
+
+int bench_decode_setup(struct bench_data *d)
+{
+    strm.bits_per_sample = d->bits_per_sample;
+    strm.block_size = d->block_size;
+    strm.rsi = d->rsi;
+    strm.flags = d->flags;
+    if (aec_decode_init(&strm) != AEC_OK)
+        return -1;
+    return 0;
+}
+
+void bench_decode_end(void)
+{
+    aec_decode_end(&strm);
+}
+
+static void start_input(const unsigned char *in, size_t len)
+{
+    struct internal_state *state = strm.state;
+
+    strm.next_in = in;
+    strm.avail_in = len + BENCH_PAD;
+    state->acc = 0;
+    state->bitp = 0;
+}
+
+static size_t run_direct_get(struct bench_data *d)
+{
+    size_t n = d->split_len * 8 / d->bits_per_sample;
+    uint32_t x = 0;
+
+    start_input(d->split, d->split_len);
+    for (size_t i = 0; i < n; i++)
+        x += direct_get(&strm, d->bits_per_sample);
+    sink = x;
+    return n;
+}
+
+static size_t run_direct_get_fs(struct bench_data *d)
+{
+    uint32_t x = 0;
+
+    start_input(d->fs, d->fs_len);
+    for (size_t i = 0; i < d->samples; i++)
+        x += direct_get_fs(&strm);
+    sink = x;
+    return d->samples;
+}
+
+static size_t run_blocks(struct bench_data *d, const unsigned char *in,
+                         size_t len, int id, int (*mode)(struct aec_stream *))
+{
+    /**
+       Decode all blocks with mode. The output stays in rsi_buffer.
+    */
+
+    struct internal_state *state = strm.state;
+
+    start_input(in, len);
+    strm.avail_out = SIZE_MAX;
+    state->id = id;
+    state->ref = 0;
+    state->encoded_block_size = d->block_size;
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        if (i % state->rsi_size == 0)
+            state->rsip = state->rsi_buffer;
+        if (mode(&strm) == M_ERROR || state->mode != m_next_cds)
+            return 0;
+    }
+    return d->samples;
+}
+
+static size_t run_m_split(struct bench_data *d)
+{
+    return run_blocks(d, d->split, d->split_len, d->k + 1, m_split);
+}
+
+static size_t run_m_se(struct bench_data *d)
+{
+    return run_blocks(d, d->se, d->se_len, 1, m_se);
+}
+
+static size_t run_flush_output(struct bench_data *d)
+{
+    /**
+       Post-process and write all RSIs. The reference samples are
+       the zeros the preprocessor put in their place.
+    */
+
+    struct internal_state *state = strm.state;
+    uint32_t *rsi_buffer = state->rsi_buffer;
+
+    for (size_t i = 0; i < d->samples; i += state->rsi_size) {
+        state->rsi_buffer = d->mapped + i;
+        state->flush_start = state->rsi_buffer;
+        state->rsip = state->rsi_buffer + state->rsi_size;
+        strm.next_out = d->out;
+        strm.avail_out = d->out_len;
+        state->flush_output(&strm);
+    }
+    state->rsi_buffer = rsi_buffer;
+    state->rsip = rsi_buffer;
+    state->flush_start = rsi_buffer;
+    return d->samples;
+}
+
+const struct bench_kernel bench_decode_kernels[] = {
+    {"direct_get", run_direct_get},
+    {"direct_get_fs", run_direct_get_fs},
+    {"m_split", run_m_split},
+    {"m_se", run_m_se},
+    {"flush_output", run_flush_output},
+    {NULL, NULL}
+};
@@ -0,0 +1,185 @@
+/**
+ * @file bench_kernels_enc.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Encoder kernels for the kernel benchmark. The encoder is
+ * compiled into this file so its static functions can be called
+ * one at a time on a stream set up by aec_encode_init().
+ *
+ */
+
+#include "encode.c"
+#include "bench_kernels.h"
+
+static struct aec_stream strm;
+
+/* Unpacked input samples of all RSIs */
+static uint32_t *raw32;
+
+/* Keeps results of pure functions alive */
+static volatile uint32_t sink;
+
+int bench_encode_setup(struct bench_data *d)
+{
+    /**
+       Initialize the encoder and preprocess all samples.
+    */
+
+    struct internal_state *state;
+    size_t n = d->rsi * d->block_size;
+
+    strm.bits_per_sample = d->bits_per_sample;
+    strm.block_size = d->block_size;
+    strm.rsi = d->rsi;
+    strm.flags = d->flags;
+    if (aec_encode_init(&strm) != AEC_OK)
+        return -1;
+    state = strm.state;
+
+    raw32 = malloc(d->samples * sizeof(uint32_t));
+    if (raw32 == NULL)
+        return -1;
+
+    strm.next_in = d->raw;
+    strm.avail_in = d->raw_len;
+    for (size_t i = 0; i < d->samples; i += n) {
+        state->get_rsi(&strm);
+        memcpy(raw32 + i, state->data_raw, n * sizeof(uint32_t));
+        state->preprocess(&strm);
+        memcpy(d->mapped + i, state->data_pp, n * sizeof(uint32_t));
+    }
+    return 0;
+}
+
+void bench_encode_end(void)
+{
+    free(raw32);
+    aec_encode_end(&strm);
+}
+
+static size_t run_get_rsi(struct bench_data *d)
+{
+    struct internal_state *state = strm.state;
+
+    strm.next_in = d->raw;
+    strm.avail_in = d->raw_len;
+    for (size_t i = 0; i < d->samples; i += state->scanline)
+        state->get_rsi(&strm);
+    return d->samples;
+}
+
+static size_t run_preprocess(struct bench_data *d)
+{
+    /* Includes copying every RSI to data_raw since the signed
+     * preprocessor works in place. */
+    struct internal_state *state = strm.state;
+    size_t n = state->scanline;
+
+    for (size_t i = 0; i < d->samples; i += n) {
+        memcpy(state->data_raw, raw32 + i, n * sizeof(uint32_t));
+        state->preprocess(&strm);
+    }
+    return d->samples;
+}
+
+static size_t run_assess_splitting_option(struct bench_data *d)
+{
+    struct internal_state *state = strm.state;
+    uint32_t len = 0;
+
+    state->k = 0;
+    state->ref = 0;
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        state->block = d->mapped + i;
+        len += assess_splitting_option(&strm);
+    }
+    sink = len;
+    return d->samples;
+}
+
+static size_t run_assess_se_option(struct bench_data *d)
+{
+    struct internal_state *state = strm.state;
+    uint32_t len = 0;
+
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        state->block = d->mapped + i;
+        len += assess_se_option(&strm);
+    }
+    sink = len;
+    return d->samples;
+}
+
+static void start_emit(struct bench_data *d)
+{
+    struct internal_state *state = strm.state;
+
+    state->cds = d->out;
+    *state->cds = 0;
+    state->bits = 8;
+}
+
+static size_t run_emitblock_fs(struct bench_data *d)
+{
+    struct internal_state *state = strm.state;
+
+    start_emit(d);
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        state->block = d->mapped + i;
+        emitblock_fs(&strm, d->k, 0);
+    }
+    return d->samples;
+}
+
+static size_t run_emitblock(struct bench_data *d)
+{
+    /* The encoder never calls emitblock() with k = 0 */
+    struct internal_state *state = strm.state;
+    int k = d->k ? d->k : 1;
+
+    start_emit(d);
+    for (size_t i = 0; i < d->samples; i += d->block_size) {
+        state->block = d->mapped + i;
+        emitblock(&strm, k, 0);
+    }
+    return d->samples;
+}
+
+const struct bench_kernel bench_encode_kernels[] = {
+    {"get_rsi", run_get_rsi},
+    {"preprocess", run_preprocess},
+    {"assess_splitting_option", run_assess_splitting_option},
+    {"assess_se_option", run_assess_se_option},
+    {"emitblock_fs", run_emitblock_fs},
+    {"emitblock", run_emitblock},
+    {NULL, NULL}
+};
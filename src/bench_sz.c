@@ -0,0 +1,191 @@
+/**
+ * @file bench_sz.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Throughput of the szip compatibility functions. Compresses and
+ * decompresses a file in memory several times and reports the
+ * median speed. The default parameters match the 32 bit sample
+ * data in data/121B2TestData/ExtendedParameters/sar32bit.dat.
+ *
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "szlib.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *t, int n)
+{
+    qsort(t, n, sizeof(double), cmp_double);
+    return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [OPTION]... FILE\n", name);
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -b BITS  bits per pixel (default 32)\n");
+    fprintf(stderr, "  -j SIZE  pixels per block (default 16)\n");
+    fprintf(stderr, "  -s SIZE  pixels per scanline (default 256 * SIZE)\n");
+    fprintf(stderr, "  -r N     repetitions (default 11)\n");
+    fprintf(stderr, "  -m       samples are MSB first\n");
+    fprintf(stderr, "  -N       don't use the preprocessor\n");
+}
+
+int main(int argc, char *argv[])
+{
+    SZ_com_t param;
+    unsigned char *source = NULL, *comp = NULL, *back = NULL;
+    double *tc = NULL, *td = NULL;
+    size_t source_len, comp_len = 0, back_len;
+    int reps = 11;
+    int msb = 0;
+    int nn = 1;
+    int status = 1;
+    int opt;
+    FILE *fp;
+
+    param.bits_per_pixel = 32;
+    param.pixels_per_block = 16;
+    param.pixels_per_scanline = 0;
+
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        char o = argv[opt][1];
+        if (o == 'm') {
+            msb = 1;
+        } else if (o == 'N') {
+            nn = 0;
+        } else if ((o == 'b' || o == 'j' || o == 's' || o == 'r')
+                   && opt + 1 < argc) {
+            int v = atoi(argv[++opt]);
+            if (o == 'b')
+                param.bits_per_pixel = v;
+            else if (o == 'j')
+                param.pixels_per_block = v;
+            else if (o == 's')
+                param.pixels_per_scanline = v;
+            else
+                reps = v;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt + 1 != argc || reps < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (param.pixels_per_scanline == 0)
+        param.pixels_per_scanline = 256 * param.pixels_per_block;
+    param.options_mask = (msb ? SZ_MSB_OPTION_MASK : SZ_LSB_OPTION_MASK)
+        | (nn ? SZ_NN_OPTION_MASK : SZ_RAW_OPTION_MASK);
+
+    if ((fp = fopen(argv[opt], "rb")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", argv[opt]);
+        return 1;
+    }
+    fseek(fp, 0L, SEEK_END);
+    source_len = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    source = malloc(source_len);
+    comp = malloc(source_len + source_len / 4 + 1024);
+    back = malloc(source_len);
+    tc = malloc(reps * sizeof(double));
+    td = malloc(reps * sizeof(double));
+    if (source == NULL || comp == NULL || back == NULL
+        || tc == NULL || td == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        goto DESTRUCT;
+    }
+    source_len = fread(source, 1, source_len, fp);
+
+    for (int r = 0; r < reps; r++) {
+        double t0;
+
+        comp_len = source_len + source_len / 4 + 1024;
+        t0 = now();
+        if (SZ_BufftoBuffCompress(comp, &comp_len, source, source_len,
+                                  &param) != SZ_OK) {
+            fprintf(stderr, "Compression failed\n");
+            goto DESTRUCT;
+        }
+        tc[r] = now() - t0;
+
+        back_len = source_len;
+        t0 = now();
+        if (SZ_BufftoBuffDecompress(back, &back_len, comp, comp_len,
+                                    &param) != SZ_OK) {
+            fprintf(stderr, "Decompression failed\n");
+            goto DESTRUCT;
+        }
+        td[r] = now() - t0;
+
+        if (back_len != source_len || memcmp(source, back, source_len)) {
+            fprintf(stderr, "Decompressed data differs\n");
+            goto DESTRUCT;
+        }
+    }
+
+    printf("%zu bytes, ratio %.3f\n", source_len,
+           (double)source_len / comp_len);
+    printf("compress   %8.1f MiB/s\n",
+           source_len / 1048576.0 / median(tc, reps));
+    printf("decompress %8.1f MiB/s\n",
+           source_len / 1048576.0 / median(td, reps));
+    status = 0;
+
+DESTRUCT:
+    fclose(fp);
+    free(source);
+    free(comp);
+    free(back);
+    free(tc);
+    free(td);
+    return status;
+}
@@ -39,6 +39,7 @@
 #include "config.h"
 #include "decode.h"
 #include "libaec.h"
+#include "threads.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +49,37 @@
 #endif
 
 #define ROS 5
+
+/* Output samples a thread should at least get */
+#define GROUP_SAMPLES (1 << 16)
+
+/* FSM states in the profile. flush_output is timed where the FSM
+ * calls it. */
+#define DECODE_STATES(X)                        \
+    X(m_id)                                     \
+    X(m_next_cds)                               \
+    X(m_split)                                  \
+    X(m_split_fs)                               \
+    X(m_split_output)                           \
+    X(m_zero_block)                             \
+    X(m_zero_output)                            \
+    X(m_se)                                     \
+    X(m_se_decode)                              \
+    X(m_low_entropy)                            \
+    X(m_low_entropy_ref)                        \
+    X(m_uncomp)                                 \
+    X(m_uncomp_copy)                            \
+    X(flush_output)
+
+#define PROFILE_ID(name) P_##name,
+enum { P_NONE, DECODE_STATES(PROFILE_ID) P_STATES };
+
+#if ENABLE_PROFILE
+#define PROFILE_NAME(name) #name,
+static const char *const profile_names[] = {
+    "", DECODE_STATES(PROFILE_NAME)
+};
+#endif
 #define RSI_USED_SIZE(state) ((size_t)(state->rsip - state->rsi_buffer))
 #define BUFFERSPACE(strm) (strm->avail_in >= strm->state->in_blklen      \
                            && strm->avail_out >= strm->state->out_blklen)
@@ -60,6 +92,15 @@
         struct internal_state *state = strm->state;                      \
                                                                          \
         flush_end = state->rsip;                                         \
+        if (flush_end > state->rsi_buffer + state->scanline) {           \
+            /* Drop padding and return the output space reserved */     \
+            bp = state->rsi_buffer + state->scanline;                    \
+            if (bp < state->flush_start)                                 \
+                bp = state->flush_start;                                 \
+            strm->avail_out +=                                           \
+                (flush_end - bp) * state->bytes_per_sample;              \
+            flush_end = state->rsi_buffer + state->scanline;             \
+        }                                                                \
         if (state->pp) {                                                 \
             if (state->flush_start == state->rsi_buffer                  \
                 && state->rsip > state->rsi_buffer) {                    \
@@ -174,6 +215,87 @@ static inline void put_8(struct aec_stream *strm, uint32_t data)
     *strm->next_out++ = (unsigned char)data;
 }
 
+static void seek_planes(struct internal_state *state, size_t p)
+{
+    /**
+       Move the output cursor to byte p of the virtual concatenation
+       of byte planes.
+    */
+
+    size_t n = state->plane_len;
+
+    if (n != SIZE_MAX && p < n * state->wordsize) {
+        state->plane_i = p % n;
+        state->plane_j = p / n;
+        state->plane_out = state->planes_base
+            + state->plane_i * state->wordsize + state->plane_j;
+        state->plane_stride = state->wordsize;
+    } else {
+        state->plane_out = state->planes_base + p;
+        state->plane_stride = 1;
+        state->plane_len = SIZE_MAX;
+    }
+}
+
+static inline void put_plane(struct aec_stream *strm, uint32_t data)
+{
+    struct internal_state *state = strm->state;
+
+    *state->plane_out = (unsigned char)data;
+    state->plane_out += state->plane_stride;
+    strm->next_out++;
+
+    if (++state->plane_i == state->plane_len) {
+        state->plane_i = 0;
+        if (++state->plane_j < state->wordsize) {
+            state->plane_out = state->planes_base + state->plane_j;
+        } else {
+            /* Bytes after the last full word are written as is */
+            state->plane_out = state->planes_base
+                + state->plane_len * state->wordsize;
+            state->plane_stride = 1;
+            state->plane_len = SIZE_MAX;
+        }
+    }
+}
+
+#define PUT_NATIVE(BITS)                                                 \
+    static inline void put_native_##BITS(struct aec_stream *strm,        \
+                                         uint32_t data)                  \
+    {                                                                    \
+        uint##BITS##_t x = (uint##BITS##_t)data;                         \
+        memcpy(strm->next_out, &x, sizeof(x));                           \
+        strm->next_out += sizeof(x);                                     \
+    }                                                                    \
+                                                                         \
+    static inline void put_native_signed_##BITS(struct aec_stream *strm, \
+                                                uint32_t data)           \
+    {                                                                    \
+        uint32_t m = UINT32_C(1) << (strm->bits_per_sample - 1);         \
+        data &= UINT32_MAX >> (32 - strm->bits_per_sample);              \
+        put_native_##BITS(strm, (data ^ m) - m);                         \
+    }
+
+PUT_NATIVE(8)
+PUT_NATIVE(16)
+PUT_NATIVE(32)
+
+#define PUT_STRIDED(KIND)                                                \
+    static inline void put_strided_##KIND(struct aec_stream *strm,       \
+                                          uint32_t data)                 \
+    {                                                                    \
+        put_##KIND(strm, data);                                          \
+        strm->next_out += strm->state->stride_gap;                       \
+    }
+
+PUT_STRIDED(msb_32)
+PUT_STRIDED(msb_24)
+PUT_STRIDED(msb_16)
+PUT_STRIDED(lsb_32)
+PUT_STRIDED(lsb_24)
+PUT_STRIDED(lsb_16)
+PUT_STRIDED(8)
+
 FLUSH(msb_32)
 FLUSH(msb_24)
 FLUSH(msb_16)
@@ -182,6 +304,23 @@ FLUSH(lsb_24)
 FLUSH(lsb_16)
 FLUSH(8)
 
+FLUSH(strided_msb_32)
+FLUSH(strided_msb_24)
+FLUSH(strided_msb_16)
+FLUSH(strided_lsb_32)
+FLUSH(strided_lsb_24)
+FLUSH(strided_lsb_16)
+FLUSH(strided_8)
+
+FLUSH(plane)
+
+FLUSH(native_8)
+FLUSH(native_16)
+FLUSH(native_32)
+FLUSH(native_signed_8)
+FLUSH(native_signed_16)
+FLUSH(native_signed_32)
+
 static inline void put_sample(struct aec_stream *strm, uint32_t s)
 {
     struct internal_state *state = strm->state;
@@ -369,9 +508,82 @@ static inline uint32_t copysample(struct aec_stream *strm)
     return 1;
 }
 
+static inline uint64_t in_bits(struct aec_stream *strm)
+{
+    /* Bits of input consumed by the FSM so far */
+    return (uint64_t)(strm->total_in - strm->avail_in) * 8
+        - strm->state->bitp;
+}
+
+static void start_cds(struct aec_stream *strm)
+{
+    /**
+       Note the position and option of the CDS whose ID was just
+       read. Low entropy options are resolved by their own states.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_stats *stats = state->stats;
+    int modi = 1 << state->id_len;
+
+    state->cds_start = in_bits(strm) - state->id_len;
+    state->cds_id_len = state->id_len;
+    state->cds_zero_blocks = 0;
+    state->cds_rsi = RSI_USED_SIZE(state) == 0;
+
+    if (state->id == modi - 1) {
+        state->cds_count = &stats->uncomp_blocks;
+        state->cds_bits = &stats->uncomp_bits;
+    } else if (state->id > 0) {
+        state->cds_count = &stats->split_blocks[state->id - 1];
+        state->cds_bits = &stats->split_bits[state->id - 1];
+    }
+}
+
+static void count_cds(struct aec_stream *strm)
+{
+    /**
+       Add the CDS whose input was just read to the statistics.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_stats *stats = state->stats;
+
+    *state->cds_count += 1;
+    *state->cds_bits += in_bits(strm) - state->cds_start;
+    stats->zero_blocks += state->cds_zero_blocks;
+    stats->id_bits += state->cds_id_len;
+    if (state->ref)
+        stats->ref_bits += strm->bits_per_sample;
+    stats->rsis += state->cds_rsi;
+    state->cds_count = NULL;
+}
+
+static void report_rsi(struct aec_stream *strm)
+{
+    /**
+       Pass the RSI which was just decoded to the callback.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_rsi rsi;
+
+    rsi.index = state->rsi_index;
+    rsi.in_offset = (size_t)(state->rsi_start / 8);
+    rsi.out_offset = state->rsi_index * state->scanline
+        * state->bytes_per_sample;
+    rsi.bit_offset = state->rsi_start;
+    rsi.bits = state->rsi_end - state->rsi_start;
+    rsi.stats = state->stats;
+    state->rsi_callback(state->rsi_opaque, &rsi);
+    state->rsi_index++;
+    state->rsi_pending = 0;
+}
+
 static inline int m_id(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_id);
     if (strm->avail_in >= strm->state->in_blklen) {
         state->id = direct_get(strm, state->id_len);
     } else {
@@ -382,6 +594,12 @@ static inline int m_id(struct aec_stream *strm)
         state->id = bits_get(strm, state->id_len);
         bits_drop(strm, state->id_len);
     }
+    if (state->stats)
+        start_cds(strm);
+    if (state->rsi_callback && RSI_USED_SIZE(state) == 0) {
+        state->rsi_start = in_bits(strm) - state->id_len;
+        state->rsi_pending = 1;
+    }
     state->mode = state->id_table[state->id];
     return(state->mode(strm));
 }
@@ -389,7 +607,13 @@ static inline int m_id(struct aec_stream *strm)
 static int m_next_cds(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_next_cds);
+    if (state->cds_count)
+        count_cds(strm);
+    if (state->rsi_callback)
+        state->rsi_end = in_bits(strm);
     if (state->rsi_size == RSI_USED_SIZE(state)) {
+        PROFILE_ENTER(state, P_flush_output);
         state->flush_output(strm);
         state->flush_start = state->rsi_buffer;
         state->rsip = state->rsi_buffer;
@@ -399,6 +623,10 @@ static int m_next_cds(struct aec_stream *strm)
         }
         if (strm->flags & AEC_PAD_RSI)
             state->bitp -= state->bitp % 8;
+        if (state->rsi_pending) {
+            state->rsi_end = in_bits(strm);
+            report_rsi(strm);
+        }
     } else {
         state->ref = 0;
         state->encoded_block_size = strm->block_size;
@@ -409,6 +637,7 @@ static int m_next_cds(struct aec_stream *strm)
 static int m_split_output(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_split_output);
     int k = state->id - 1;
 
     do {
@@ -429,6 +658,7 @@ static int m_split_output(struct aec_stream *strm)
 static int m_split_fs(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_split_fs);
     int k = state->id - 1;
 
     do {
@@ -447,6 +677,7 @@ static int m_split_fs(struct aec_stream *strm)
 static int m_split(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_split);
 
     if (BUFFERSPACE(strm)) {
         int k = state->id - 1;
@@ -482,6 +713,7 @@ static int m_split(struct aec_stream *strm)
 static int m_zero_output(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_zero_output);
 
     do {
         if (strm->avail_out < state->bytes_per_sample)
@@ -496,6 +728,7 @@ static int m_zero_output(struct aec_stream *strm)
 static int m_zero_block(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_zero_block);
     uint32_t zero_blocks;
     uint32_t zero_samples;
     uint32_t zero_bytes;
@@ -517,6 +750,18 @@ static int m_zero_block(struct aec_stream *strm)
     if (state->rsi_size - RSI_USED_SIZE(state) < zero_samples)
         return M_ERROR;
 
+    if (state->stats) {
+        /* The input of the CDS is complete. Longer runs than a
+         * segment can only come from a faulty encoder, they share
+         * the last bin. */
+        int bin = MIN(zero_blocks, AEC_STATS_MAX_RUN) - 1;
+        state->cds_count = &state->stats->zero_runs[bin];
+        state->cds_zero_blocks = zero_blocks;
+        count_cds(strm);
+    }
+    if (state->rsi_callback)
+        state->rsi_end = in_bits(strm);
+
     zero_bytes = zero_samples * state->bytes_per_sample;
     if (strm->avail_out >= zero_bytes) {
         memset(state->rsip, 0, zero_samples * sizeof(uint32_t));
@@ -533,6 +778,7 @@ static int m_zero_block(struct aec_stream *strm)
 static int m_se_decode(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_se_decode);
 
     while(state->sample_counter < strm->block_size) {
         int32_t m;
@@ -565,6 +811,7 @@ static int m_se_decode(struct aec_stream *strm)
 static int m_se(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_se);
 
     if (BUFFERSPACE(strm)) {
         uint32_t i = state->ref;
@@ -596,6 +843,7 @@ static int m_se(struct aec_stream *strm)
 static int m_low_entropy_ref(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_low_entropy_ref);
 
     if (state->ref && copysample(strm) == 0)
         return M_EXIT;
@@ -610,11 +858,21 @@ static int m_low_entropy_ref(struct aec_stream *strm)
 static int m_low_entropy(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_low_entropy);
 
     if (bits_ask(strm, 1) == 0)
         return M_EXIT;
     state->id = bits_get(strm, 1);
     bits_drop(strm, 1);
+    if (state->stats) {
+        state->cds_id_len++;
+        if (state->id == 1) {
+            state->cds_count = &state->stats->se_blocks;
+            state->cds_bits = &state->stats->se_bits;
+        } else {
+            state->cds_bits = &state->stats->zero_bits;
+        }
+    }
     state->mode = m_low_entropy_ref;
     return M_CONTINUE;
 }
@@ -622,6 +880,7 @@ static int m_low_entropy(struct aec_stream *strm)
 static int m_uncomp_copy(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_uncomp_copy);
 
     do {
         if (copysample(strm) == 0)
@@ -635,6 +894,7 @@ static int m_uncomp_copy(struct aec_stream *strm)
 static int m_uncomp(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_uncomp);
 
     if (BUFFERSPACE(strm)) {
         for (size_t i = 0; i < strm->block_size; i++)
@@ -648,6 +908,392 @@ static int m_uncomp(struct aec_stream *strm)
     return M_CONTINUE;
 }
 
+static inline int clz64(uint64_t x)
+{
+#if HAVE_DECL___BUILTIN_CLZLL || __has_builtin(__builtin_clzll)
+    return __builtin_clzll(x);
+#elif HAVE_BSR64
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return 63 - (int)i;
+#else
+    int n = 0;
+    while ((x & (UINT64_C(1) << 63)) == 0) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || __has_builtin(__builtin_popcountll)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+    x = (x & UINT64_C(0x3333333333333333))
+        + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    return (int)((x * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
+/* Bit stream position where RSIs start. The stream consists of the
+ * bits left in the accumulator followed by the input buffer. */
+struct skim {
+    uint64_t head;
+    size_t head_bits;
+    const unsigned char *buf;
+    size_t len;
+
+    /* bit position counted from the first bit of head */
+    size_t pos;
+
+    /* total number of bits */
+    size_t end;
+};
+
+static inline uint64_t load_window(const unsigned char *buf, size_t len,
+                                   size_t q)
+{
+    /**
+       64 bits of buf starting at bit q. At least 57 are valid, bits
+       after the end of buf are zero.
+    */
+
+    size_t b = q / 8;
+    uint64_t w = 0;
+
+    if (b + 8 <= len) {
+        w = ((uint64_t)buf[b] << 56)
+            | ((uint64_t)buf[b + 1] << 48)
+            | ((uint64_t)buf[b + 2] << 40)
+            | ((uint64_t)buf[b + 3] << 32)
+            | ((uint64_t)buf[b + 4] << 24)
+            | ((uint64_t)buf[b + 5] << 16)
+            | ((uint64_t)buf[b + 6] << 8)
+            | (uint64_t)buf[b + 7];
+    } else {
+        for (size_t i = b; i < b + 8; i++)
+            w = (w << 8) | (i < len ? buf[i] : 0);
+    }
+    return w << (q % 8);
+}
+
+static inline uint64_t skim_window(const struct skim *s)
+{
+    /**
+       The next 56 bits of the stream in the MSBs.
+    */
+
+    uint64_t w;
+
+    if (s->pos >= s->head_bits) {
+        w = load_window(s->buf, s->len, s->pos - s->head_bits);
+    } else {
+        size_t h = s->head_bits - s->pos;
+        w = s->head << (64 - h);
+        if (h < 64)
+            w |= load_window(s->buf, s->len, 0) >> h;
+    }
+    return w & ~UINT64_C(0xff);
+}
+
+static inline uint32_t skim_bits(struct skim *s, int n)
+{
+    uint32_t v = (uint32_t)(skim_window(s) >> (64 - n));
+    s->pos += n;
+    return v;
+}
+
+static uint32_t skim_fs(struct skim *s)
+{
+    uint32_t fs = 0;
+
+    while (s->pos <= s->end) {
+        uint64_t w = skim_window(s);
+        if (w) {
+            int i = clz64(w);
+            s->pos += i + 1;
+            return fs + i;
+        }
+        fs += 56;
+        s->pos += 56;
+    }
+    return 0;
+}
+
+static void skim_fs_n(struct skim *s, uint32_t n)
+{
+    /**
+       Skip n fundamental sequences. They end with the n-th 1 bit.
+    */
+
+    while (n && s->pos <= s->end) {
+        uint64_t w = skim_window(s);
+        uint32_t ones = popcount64(w);
+
+        if (ones < n) {
+            n -= ones;
+            s->pos += 56;
+        } else {
+            do {
+                int i = clz64(w);
+                w <<= i + 1;
+                s->pos += i + 1;
+            } while (--n);
+        }
+    }
+}
+
+static int skim_rsi(struct aec_stream *strm, struct skim *s)
+{
+    /**
+       Move s to the start of the next RSI without decoding samples.
+       Returns 0 if the RSI is not complete in the input or invalid.
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t uncomp = (1U << state->id_len) - 1;
+    uint32_t ref = state->pp ? 1 : 0;
+    uint32_t b = 0;
+
+    while (b < strm->rsi && s->pos <= s->end) {
+        uint32_t id = skim_bits(s, state->id_len);
+        uint32_t bs = strm->block_size - ref;
+
+        if (id == 0) {
+            uint32_t se = skim_bits(s, 1);
+            s->pos += ref * strm->bits_per_sample;
+            if (se) {
+                skim_fs_n(s, strm->block_size / 2);
+                b++;
+            } else {
+                uint32_t zero_blocks = skim_fs(s) + 1;
+                if (zero_blocks == ROS)
+                    zero_blocks = MIN(strm->rsi - b, 64 - (b % 64));
+                else if (zero_blocks > ROS)
+                    zero_blocks--;
+                if (zero_blocks > strm->rsi - b)
+                    return 0;
+                b += zero_blocks;
+            }
+        } else if (id == uncomp) {
+            s->pos += strm->block_size * strm->bits_per_sample;
+            b++;
+        } else {
+            s->pos += ref * strm->bits_per_sample;
+            skim_fs_n(s, bs);
+            s->pos += bs * (id - 1);
+            b++;
+        }
+        ref = 0;
+    }
+
+    if (strm->flags & AEC_PAD_RSI) {
+        /* Align to a byte of the input buffer */
+        if (s->pos < s->head_bits)
+            s->pos = s->head_bits - ((s->head_bits - s->pos) & ~(size_t)7);
+        else
+            s->pos = s->head_bits
+                + ((s->pos - s->head_bits + 7) & ~(size_t)7);
+    }
+    return b == strm->rsi && s->pos <= s->end;
+}
+
+static void seek_input(struct aec_stream *strm, const struct skim *s,
+                       size_t pos)
+{
+    /**
+       Let the decoder continue at bit pos of s.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (pos < s->head_bits) {
+        state->acc = s->head;
+        state->bitp = (int)(s->head_bits - pos);
+        strm->next_in = s->buf;
+        strm->avail_in = s->len;
+    } else {
+        size_t q = pos - s->head_bits;
+        strm->next_in = s->buf + q / 8;
+        strm->avail_in = s->len - q / 8;
+        state->acc = 0;
+        state->bitp = 0;
+        if (q % 8) {
+            state->acc = *strm->next_in++;
+            strm->avail_in--;
+            state->bitp = (int)(8 - q % 8);
+        }
+    }
+}
+
+static int decode_fsm(struct aec_stream *strm)
+{
+    /**
+       Run the FSM until it needs more input or output.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t avail_out;
+    int status;
+
+    do {
+        do {
+            status = state->mode(strm);
+        } while (status == M_CONTINUE);
+
+        if (status == M_ERROR)
+            return AEC_DATA_ERROR;
+
+        if (status == M_EXIT && strm->avail_out > state->stride_gap &&
+            strm->avail_out < state->bytes_per_sample)
+            return AEC_MEM_ERROR;
+
+        /* Dropping scanline padding in the flush can free output
+         * space. Carry on decoding if it does. */
+        avail_out = strm->avail_out;
+        PROFILE_ENTER(state, P_flush_output);
+        state->flush_output(strm);
+    } while (strm->avail_out > avail_out);
+    return AEC_OK;
+}
+
+struct decode_group {
+    /* copy of the stream with its own state */
+    struct aec_stream strm;
+    struct internal_state *master;
+    const struct skim *skim;
+
+    /* bit position of the first RSI and output of the group */
+    size_t start;
+    unsigned char *next_out;
+    size_t out_len;
+    int status;
+};
+
+static void decode_group(void *arg)
+{
+    /**
+       Decode the RSIs of a group straight to their place in the
+       output.
+    */
+
+    struct decode_group *g = arg;
+    struct aec_stream *strm = &g->strm;
+    struct internal_state *state;
+
+    g->status = AEC_MEM_ERROR;
+    state = malloc(sizeof(struct internal_state));
+    if (state == NULL)
+        return;
+    *state = *g->master;
+    state->rsi_buffer = malloc(state->rsi_size * sizeof(uint32_t));
+    if (state->rsi_buffer == NULL) {
+        free(state);
+        return;
+    }
+    state->rsip = state->rsi_buffer;
+    state->flush_start = state->rsi_buffer;
+    strm->state = state;
+
+    seek_input(strm, g->skim, g->start);
+    strm->next_out = g->next_out;
+    strm->avail_out = g->out_len;
+    if (state->flush_output == flush_plane)
+        seek_planes(state, strm->next_out - state->planes_base);
+
+    g->status = decode_fsm(strm);
+    if (g->status == AEC_OK && strm->avail_out)
+        g->status = AEC_DATA_ERROR;
+
+    free(state->rsi_buffer);
+    free(state);
+}
+
+static void decode_parallel(struct aec_stream *strm)
+{
+    /**
+       Decode whole RSIs in groups, one per thread.
+
+       A quick pass over the input finds where RSIs start without
+       decoding them. Groups run up to the first one which fails,
+       the FSM takes over from there and reports errors as usual.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t rsi_out = state->scanline * state->bytes_per_sample;
+    size_t max_rsis = strm->avail_out / rsi_out;
+    size_t rsis = 0;
+    size_t cap = 1024;
+    size_t n, done;
+    size_t *pos;
+    struct decode_group *groups;
+    struct skim s;
+
+    if (max_rsis * state->scanline / GROUP_SAMPLES < 2)
+        return;
+
+    s.head = state->bitp
+        ? state->acc & (UINT64_MAX >> (64 - state->bitp)) : 0;
+    s.head_bits = state->bitp;
+    s.buf = strm->next_in;
+    s.len = strm->avail_in;
+    s.pos = 0;
+    s.end = s.head_bits + 8 * s.len;
+
+    pos = malloc(cap * sizeof(size_t));
+    if (pos == NULL)
+        return;
+    pos[0] = 0;
+    while (rsis < max_rsis && skim_rsi(strm, &s)) {
+        if (rsis + 1 == cap) {
+            size_t *p = realloc(pos, 2 * cap * sizeof(size_t));
+            if (p == NULL)
+                break;
+            pos = p;
+            cap *= 2;
+        }
+        pos[++rsis] = s.pos;
+    }
+
+    n = MIN((size_t)state->threads, rsis * state->scanline / GROUP_SAMPLES);
+    n = MIN(n, rsis);
+    groups = n < 2 ? NULL : malloc(n * sizeof(struct decode_group));
+    if (groups == NULL) {
+        free(pos);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t first = rsis * i / n;
+        groups[i].strm = *strm;
+        groups[i].master = state;
+        groups[i].skim = &s;
+        groups[i].start = pos[first];
+        groups[i].next_out = strm->next_out + first * rsi_out;
+        groups[i].out_len = (rsis * (i + 1) / n - first) * rsi_out;
+    }
+    aec_run_tasks(decode_group, groups, sizeof(struct decode_group),
+                  (int)n);
+
+    for (done = 0; done < n; done++)
+        if (groups[done].status != AEC_OK)
+            break;
+    if (done) {
+        size_t last = rsis * done / n;
+        seek_input(strm, &s, pos[last]);
+        strm->next_out += last * rsi_out;
+        strm->avail_out -= last * rsi_out;
+        if (state->flush_output == flush_plane)
+            seek_planes(state, strm->next_out - state->planes_base);
+    }
+    free(groups);
+    free(pos);
+}
+
 static void create_se_table(int *table)
 {
     int k = 0;
@@ -661,23 +1307,18 @@ static void create_se_table(int *table)
     }
 }
 
-int aec_decode_init(struct aec_stream *strm)
+static int setup_state(struct aec_stream *strm)
 {
-    struct internal_state *state;
-    int modi;
-
-    if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
-        return AEC_CONF_ERROR;
+    /**
+       Derive the decoder configuration from the stream parameters.
+       Buffers already present in the zeroed state are reused.
+    */
 
-    state = malloc(sizeof(struct internal_state));
-    if (state == NULL)
-        return AEC_MEM_ERROR;
-    memset(state, 0, sizeof(struct internal_state));
+    struct internal_state *state = strm->state;
+    int modi;
 
     create_se_table(state->se_table);
 
-    strm->state = state;
-
     if (strm->bits_per_sample > 16) {
         state->id_len = 5;
 
@@ -735,9 +1376,12 @@ int aec_decode_init(struct aec_stream *strm)
                         + state->id_len) / 8 + 16;
 
     modi = 1UL << state->id_len;
-    state->id_table = malloc(modi * sizeof(int (*)(struct aec_stream *)));
-    if (state->id_table == NULL)
-        return AEC_MEM_ERROR;
+    if (state->id_table == NULL) {
+        state->id_table = malloc(modi
+                                 * sizeof(int (*)(struct aec_stream *)));
+        if (state->id_table == NULL)
+            return AEC_MEM_ERROR;
+    }
 
     state->id_table[0] = m_low_entropy;
     for (int i = 1; i < modi - 1; i++) {
@@ -746,9 +1390,12 @@ int aec_decode_init(struct aec_stream *strm)
     state->id_table[modi - 1] = m_uncomp;
 
     state->rsi_size = strm->rsi * strm->block_size;
-    state->rsi_buffer = malloc(state->rsi_size * sizeof(uint32_t));
-    if (state->rsi_buffer == NULL)
-        return AEC_MEM_ERROR;
+    state->scanline = state->rsi_size;
+    if (state->rsi_buffer == NULL) {
+        state->rsi_buffer = malloc(state->rsi_size * sizeof(uint32_t));
+        if (state->rsi_buffer == NULL)
+            return AEC_MEM_ERROR;
+    }
 
     state->pp = strm->flags & AEC_DATA_PREPROCESS;
     if (state->pp) {
@@ -769,6 +1416,172 @@ int aec_decode_init(struct aec_stream *strm)
     return AEC_OK;
 }
 
+int aec_decode_init(struct aec_stream *strm)
+{
+    struct internal_state *state;
+
+    if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
+        return AEC_CONF_ERROR;
+
+    state = malloc(sizeof(struct internal_state));
+    if (state == NULL)
+        return AEC_MEM_ERROR;
+    memset(state, 0, sizeof(struct internal_state));
+
+    strm->state = state;
+    return setup_state(strm);
+}
+
+int aec_decode_set_stride(struct aec_stream *strm, size_t stride)
+{
+    /**
+       Write samples stride bytes apart.
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t size = state->bytes_per_sample - state->stride_gap;
+    int msb = strm->flags & AEC_DATA_MSB;
+
+    if (stride < size || stride > UINT32_MAX / strm->block_size)
+        return AEC_CONF_ERROR;
+
+    if (size == 4)
+        state->flush_output = msb ? flush_strided_msb_32
+            : flush_strided_lsb_32;
+    else if (size == 3)
+        state->flush_output = msb ? flush_strided_msb_24
+            : flush_strided_lsb_24;
+    else if (size == 2)
+        state->flush_output = msb ? flush_strided_msb_16
+            : flush_strided_lsb_16;
+    else
+        state->flush_output = flush_strided_8;
+
+    state->bytes_per_sample = (uint32_t)stride;
+    state->stride_gap = (uint32_t)stride - size;
+    state->out_blklen = strm->block_size * state->bytes_per_sample;
+    return AEC_OK;
+}
+
+int aec_decode_set_planes(struct aec_stream *strm, size_t wordsize,
+                          size_t words)
+{
+    /**
+       Write decoded bytes to the byte planes of the words at
+       next_out.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (state->flush_output != flush_8 || wordsize == 0)
+        return AEC_CONF_ERROR;
+
+    if (words == 0)
+        return AEC_OK;
+
+    state->planes_base = strm->next_out;
+    state->plane_len = words;
+    state->wordsize = wordsize;
+    seek_planes(state, 0);
+    state->flush_output = flush_plane;
+    return AEC_OK;
+}
+
+int aec_decode_set_scanline(struct aec_stream *strm, size_t samples)
+{
+    /**
+       Only output the first samples of every RSI.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (samples == 0 || samples > state->rsi_size)
+        return AEC_CONF_ERROR;
+
+    state->scanline = samples;
+    return AEC_OK;
+}
+
+static void add_stride_gap(struct aec_stream *strm)
+{
+    /**
+       Skip what is left of the gap behind the last sample of the
+       previous call. The last sample of strided output doesn't need
+       a full stride. Pretend it does while the FSM is running.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t skip = MIN(state->stride_skip, strm->avail_out);
+
+    strm->next_out += skip;
+    strm->avail_out -= skip;
+    state->stride_skip -= (uint32_t)skip;
+    strm->avail_out += state->stride_gap;
+}
+
+static void remove_stride_gap(struct aec_stream *strm)
+{
+    /**
+       Take back the bytes which add_stride_gap() added to avail_out.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (strm->avail_out >= state->stride_gap) {
+        strm->avail_out -= state->stride_gap;
+    } else {
+        state->stride_skip = state->stride_gap - (uint32_t)strm->avail_out;
+        strm->next_out -= state->stride_skip;
+        strm->avail_out = 0;
+    }
+}
+
+int aec_decode_set_threads(struct aec_stream *strm, int threads)
+{
+    /**
+       Decode whole RSIs in the input on up to threads threads.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (threads < 0)
+        return AEC_CONF_ERROR;
+    if (threads == 0)
+        threads = aec_cpu_count();
+    state->threads = MIN(threads, AEC_MAX_THREADS);
+    return AEC_OK;
+}
+
+int aec_decode_set_stats(struct aec_stream *strm, struct aec_stats *stats)
+{
+    /**
+       Count the code options read in stats from now on.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (stats)
+        memset(stats, 0, sizeof(struct aec_stats));
+    state->stats = stats;
+    return AEC_OK;
+}
+
+int aec_decode_set_rsi_callback(struct aec_stream *strm,
+                                void (*callback)(void *opaque,
+                                                 const struct aec_rsi *rsi),
+                                void *opaque)
+{
+    /**
+       Call callback whenever an RSI is decoded.
+    */
+
+    struct internal_state *state = strm->state;
+
+    state->rsi_callback = callback;
+    state->rsi_opaque = opaque;
+    return AEC_OK;
+}
+
 int aec_decode(struct aec_stream *strm, int flush)
 {
     /**
@@ -786,18 +1599,22 @@ int aec_decode(struct aec_stream *strm, int flush)
     strm->total_in += strm->avail_in;
     strm->total_out += strm->avail_out;
 
-    do {
-        status = state->mode(strm);
-    } while (status == M_CONTINUE);
+    add_stride_gap(strm);
 
-    if (status == M_ERROR)
-        return AEC_DATA_ERROR;
+    if (state->threads > 1 && state->stats == NULL
+        && state->rsi_callback == NULL && state->mode == m_id
+        && state->rsip == state->rsi_buffer && state->stride_skip == 0)
+        decode_parallel(strm);
 
-    if (status == M_EXIT && strm->avail_out > 0 &&
-        strm->avail_out < state->bytes_per_sample)
-        return AEC_MEM_ERROR;
+    status = decode_fsm(strm);
+    PROFILE_LEAVE(state);
+    remove_stride_gap(strm);
+    if (status != AEC_OK)
+        return status;
 
-    state->flush_output(strm);
+    /* A short last RSI is complete when the input is */
+    if (flush == AEC_FLUSH && state->rsi_pending && strm->avail_in == 0)
+        report_rsi(strm);
 
     strm->total_in -= strm->avail_in;
     strm->total_out -= strm->avail_out;
@@ -809,12 +1626,39 @@ int aec_decode_end(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
 
+#if ENABLE_PROFILE
+    aec_profile_dump(&state->profile, "decoder", profile_names, P_STATES);
+#endif
     free(state->id_table);
     free(state->rsi_buffer);
     free(state);
     return AEC_OK;
 }
 
+int aec_decode_reset(struct aec_stream *strm)
+{
+    /**
+       Same as aec_decode_end() followed by aec_decode_init() with
+       unchanged parameters, but the buffers are kept.
+    */
+
+    struct internal_state *state = strm->state;
+    int (**id_table)(struct aec_stream *) = state->id_table;
+    uint32_t *rsi_buffer = state->rsi_buffer;
+#if ENABLE_PROFILE
+    /* The profile adds up over all streams */
+    struct aec_profile profile = state->profile;
+#endif
+
+    memset(state, 0, sizeof(struct internal_state));
+    state->id_table = id_table;
+    state->rsi_buffer = rsi_buffer;
+#if ENABLE_PROFILE
+    state->profile = profile;
+#endif
+    return setup_state(strm);
+}
+
 int aec_buffer_decode(struct aec_stream *strm)
 {
     int status = aec_decode_init(strm);
@@ -825,3 +1669,76 @@ int aec_buffer_decode(struct aec_stream *strm)
     aec_decode_end(strm);
     return status;
 }
+
+static int buffer_decode_native(struct aec_stream *strm, void *dest,
+                                size_t n, uint32_t size, int is_signed)
+{
+    /**
+       Buffer decoding to host integers of size bytes.
+    */
+
+    struct internal_state *state;
+    int status;
+
+    if (strm->bits_per_sample > 8 * size)
+        return AEC_CONF_ERROR;
+
+    if (is_signed)
+        strm->flags |= AEC_DATA_SIGNED;
+    else
+        strm->flags &= ~AEC_DATA_SIGNED;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    state = strm->state;
+    if (size == 4)
+        state->flush_output = is_signed ? flush_native_signed_32
+            : flush_native_32;
+    else if (size == 2)
+        state->flush_output = is_signed ? flush_native_signed_16
+            : flush_native_16;
+    else
+        state->flush_output = is_signed ? flush_native_signed_8
+            : flush_native_8;
+    state->bytes_per_sample = size;
+    state->out_blklen = strm->block_size * state->bytes_per_sample;
+
+    strm->next_out = dest;
+    strm->avail_out = n * size;
+
+    status = aec_decode(strm, AEC_FLUSH);
+    aec_decode_end(strm);
+    return status;
+}
+
+int aec_decode_u8(struct aec_stream *strm, uint8_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 1, 0);
+}
+
+int aec_decode_u16(struct aec_stream *strm, uint16_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 2, 0);
+}
+
+int aec_decode_u32(struct aec_stream *strm, uint32_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 4, 0);
+}
+
+int aec_decode_i8(struct aec_stream *strm, int8_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 1, 1);
+}
+
+int aec_decode_i16(struct aec_stream *strm, int16_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 2, 1);
+}
+
+int aec_decode_i32(struct aec_stream *strm, int32_t *dest, size_t n)
+{
+    return buffer_decode_native(strm, dest, n, 4, 1);
+}
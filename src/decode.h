@@ -40,6 +40,7 @@
 #define DECODE_H 1
 
 #include "config.h"
+#include "profile.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -52,6 +53,8 @@
 #define SE_TABLE_SIZE 90
 
 struct aec_stream;
+struct aec_stats;
+struct aec_rsi;
 
 struct internal_state {
     int (*mode)(struct aec_stream *);
@@ -103,9 +106,17 @@ struct internal_state {
     /* 1 if postprocessor has to be used */
     int pp;
 
-    /* storage size of samples in bytes */
+    /* output bytes per sample. Storage size of samples or stride if
+       output is strided */
     uint32_t bytes_per_sample;
 
+    /* bytes between the end of a sample and the next sample in
+       strided output */
+    uint32_t stride_gap;
+
+    /* gap bytes still to be skipped at the start of the next call */
+    uint32_t stride_skip;
+
     /* output buffer holding one reference sample interval */
     uint32_t *rsi_buffer;
 
@@ -115,11 +126,60 @@ struct internal_state {
     /* rsi in bytes */
     size_t rsi_size;
 
+    /* samples per RSI which are output. The remainder is scanline
+       padding and dropped */
+    size_t scanline;
+
     /* first not yet flushed byte in rsi_buffer */
     uint32_t *flush_start;
 
+    /* byte planes of words: output is written as byte 0 of all
+       words, then byte 1 and so on */
+    unsigned char *planes_base;
+    size_t plane_len;
+    size_t wordsize;
+
+    /* position of the next output byte in the words */
+    unsigned char *plane_out;
+    size_t plane_i;
+    size_t plane_j;
+    size_t plane_stride;
+
+    /* number of threads for whole RSIs in the input */
+    int threads;
+
+    /* caller owned statistics or NULL */
+    struct aec_stats *stats;
+
+    /* The current CDS is counted once its input is read: input
+       bit position of its ID, counters of its option or NULL, ID
+       bits, zero blocks and whether it starts an RSI */
+    uint64_t cds_start;
+    uint64_t *cds_count;
+    uint64_t *cds_bits;
+    int cds_id_len;
+    uint32_t cds_zero_blocks;
+    int cds_rsi;
+
+    /* RSI callback or NULL and its argument */
+    void (*rsi_callback)(void *, const struct aec_rsi *);
+    void *rsi_opaque;
+
+    /* number of the current RSI, input bit positions of its start
+       and of the end of its last complete CDS, 1 if it has not been
+       reported yet */
+    size_t rsi_index;
+    uint64_t rsi_start;
+    uint64_t rsi_end;
+    int rsi_pending;
+
     /* table for decoding second extension option */
     int se_table[2 * (SE_TABLE_SIZE + 1)];
+
+#if ENABLE_PROFILE
+    /* time spent in the FSM states */
+    struct aec_profile profile;
+#endif
 } decode_state;
 
 #endif /* DECODE_H */
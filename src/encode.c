@@ -40,10 +40,37 @@
 #include "encode.h"
 #include "encode_accessors.h"
 #include "libaec.h"
+#include "threads.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Input samples a thread should at least get */
+#define GROUP_SAMPLES (1 << 16)
+
+/* FSM states in the profile */
+#define ENCODE_STATES(X)                        \
+    X(m_get_block)                              \
+    X(m_get_rsi_resumable)                      \
+    X(m_check_zero_block)                       \
+    X(m_select_code_option)                     \
+    X(m_encode_splitting)                       \
+    X(m_encode_se)                              \
+    X(m_encode_zero)                            \
+    X(m_encode_uncomp)                          \
+    X(m_flush_block)                            \
+    X(m_flush_block_resumable)
+
+#define PROFILE_ID(name) P_##name,
+enum { P_NONE, ENCODE_STATES(PROFILE_ID) P_STATES };
+
+#if ENABLE_PROFILE
+#define PROFILE_NAME(name) #name,
+static const char *const profile_names[] = {
+    "", ENCODE_STATES(PROFILE_NAME)
+};
+#endif
+
 static int m_get_block(struct aec_stream *strm);
 
 static inline void emit(struct internal_state *state,
@@ -439,6 +466,54 @@ static void init_output(struct aec_stream *strm)
     }
 }
 
+static void count_cds(struct aec_stream *strm, uint64_t *cdss,
+                      uint64_t *bits, const uint8_t *cds, int free_bits,
+                      int id_len, int ref)
+{
+    /**
+       Add the CDS which was emitted since the output position
+       cds/free_bits to the statistics.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_stats *stats = state->stats;
+
+    *cdss += 1;
+    *bits += (uint64_t)(state->cds - cds) * 8 + free_bits - state->bits;
+    stats->id_bits += id_len;
+    if (ref)
+        stats->ref_bits += strm->bits_per_sample;
+}
+
+static uint64_t out_bits(struct aec_stream *strm)
+{
+    /* Bits of output emitted so far. Exact between CDSs when all
+     * but the last partial byte have been flushed */
+    return (uint64_t)(strm->total_out - strm->avail_out) * 8
+        + 8 - strm->state->bits;
+}
+
+static void report_rsi(struct aec_stream *strm)
+{
+    /**
+       Pass the RSI which was just coded to the callback.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_rsi rsi;
+
+    rsi.index = state->rsi_index;
+    rsi.in_offset = state->rsi_index * state->scanline
+        * state->bytes_per_sample;
+    rsi.out_offset = (size_t)(state->rsi_start / 8);
+    rsi.bit_offset = state->rsi_start;
+    rsi.bits = out_bits(strm) - state->rsi_start;
+    rsi.stats = state->stats;
+    state->rsi_callback(state->rsi_opaque, &rsi);
+    state->rsi_index++;
+    state->rsi_pending = 0;
+}
+
 /*
  *
  * FSM functions
@@ -451,6 +526,7 @@ static int m_flush_block_resumable(struct aec_stream *strm)
        Slow and restartable flushing
     */
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_flush_block_resumable);
 
     int n = (int)MIN((size_t)(state->cds - state->cds_buf - state->i),
                      strm->avail_out);
@@ -475,6 +551,7 @@ static int m_flush_block(struct aec_stream *strm)
        Fall back to slow flushing if in buffered mode.
     */
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_flush_block);
 
 #ifdef ENABLE_RSI_PADDING
     if (state->blocks_avail == 0
@@ -500,7 +577,10 @@ static int m_flush_block(struct aec_stream *strm)
 static int m_encode_splitting(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_encode_splitting);
     int k = state->k;
+    uint8_t *cds = state->cds;
+    int bits = state->bits;
 
     emit(state, k + 1, state->id_len);
     if (state->ref)
@@ -510,23 +590,38 @@ static int m_encode_splitting(struct aec_stream *strm)
     if (k)
         emitblock(strm, k, state->ref);
 
+    if (state->stats)
+        count_cds(strm, &state->stats->split_blocks[k],
+                  &state->stats->split_bits[k], cds, bits,
+                  state->id_len, state->ref);
     return m_flush_block(strm);
 }
 
 static int m_encode_uncomp(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_encode_uncomp);
+    uint8_t *cds = state->cds;
+    int bits = state->bits;
 
     emit(state, (1U << state->id_len) - 1, state->id_len);
     if (state->ref)
         state->block[0] = state->ref_sample;
     emitblock(strm, strm->bits_per_sample, 0);
+
+    if (state->stats)
+        count_cds(strm, &state->stats->uncomp_blocks,
+                  &state->stats->uncomp_bits, cds, bits,
+                  state->id_len, state->ref);
     return m_flush_block(strm);
 }
 
 static int m_encode_se(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_encode_se);
+    uint8_t *cds = state->cds;
+    int bits = state->bits;
 
     emit(state, 1, state->id_len + 1);
     if (state->ref)
@@ -537,12 +632,18 @@ static int m_encode_se(struct aec_stream *strm)
         emitfs(state, d * (d + 1) / 2 + state->block[i + 1]);
     }
 
+    if (state->stats)
+        count_cds(strm, &state->stats->se_blocks, &state->stats->se_bits,
+                  cds, bits, state->id_len + 1, state->ref);
     return m_flush_block(strm);
 }
 
 static int m_encode_zero(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_encode_zero);
+    uint8_t *cds = state->cds;
+    int bits = state->bits;
 
     emit(state, 0, state->id_len + 1);
 
@@ -556,6 +657,15 @@ static int m_encode_zero(struct aec_stream *strm)
     else
         emitfs(state, state->zero_blocks - 1);
 
+    if (state->stats) {
+        struct aec_stats *stats = state->stats;
+        int run = state->zero_blocks == ROS
+            ? state->ros_blocks : state->zero_blocks;
+
+        count_cds(strm, &stats->zero_runs[run - 1], &stats->zero_bits,
+                  cds, bits, state->id_len + 1, state->zero_ref);
+        stats->zero_blocks += run;
+    }
     state->zero_blocks = 0;
     return m_flush_block(strm);
 }
@@ -567,6 +677,7 @@ static int m_select_code_option(struct aec_stream *strm)
     */
 
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_select_code_option);
 
     uint32_t split_len;
     uint32_t se_len;
@@ -599,6 +710,7 @@ static int m_check_zero_block(struct aec_stream *strm)
     */
 
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_check_zero_block);
     uint32_t *p = state->block;
 
     size_t i;
@@ -625,8 +737,10 @@ static int m_check_zero_block(struct aec_stream *strm)
             state->zero_ref_sample = state->ref_sample;
         }
         if (state->blocks_avail == 0 || state->blocks_dispensed % 64 == 0) {
-            if (state->zero_blocks > 4)
+            if (state->zero_blocks > 4) {
+                state->ros_blocks = state->zero_blocks;
                 state->zero_blocks = ROS;
+            }
 
             state->mode = m_encode_zero;
             return M_CONTINUE;
@@ -636,6 +750,19 @@ static int m_check_zero_block(struct aec_stream *strm)
     }
 }
 
+static void pad_scanline(struct aec_stream *strm)
+{
+    /**
+       Pad the raw buffer from sample i to the end of the RSI.
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t pad = state->pad_zero ? 0 : state->data_raw[state->i - 1];
+
+    while (state->i < strm->rsi * strm->block_size)
+        state->data_raw[state->i++] = pad;
+}
+
 static int m_get_rsi_resumable(struct aec_stream *strm)
 {
     /**
@@ -646,13 +773,19 @@ static int m_get_rsi_resumable(struct aec_stream *strm)
     */
 
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_get_rsi_resumable);
 
     do {
         if (strm->avail_in >= state->bytes_per_sample) {
             state->data_raw[state->i] = state->get_sample(strm);
         } else {
             if (state->flush == AEC_FLUSH) {
-                if (state->i > 0) {
+                if (state->i > 0 && state->pad_scanline) {
+                    /* The last scanline is padded and encoded in
+                     * full like all others. */
+                    pad_scanline(strm);
+                    break;
+                } else if (state->i > 0) {
                     state->blocks_avail = state->i / strm->block_size - 1;
                     if (state->i % strm->block_size)
                         state->blocks_avail++;
@@ -678,11 +811,17 @@ static int m_get_rsi_resumable(struct aec_stream *strm)
                 return M_EXIT;
             }
         }
-    } while (++state->i < strm->rsi * strm->block_size);
+    } while (++state->i < state->scanline);
+
+    if (state->pad_scanline)
+        pad_scanline(strm);
 
     if (strm->flags & AEC_DATA_PREPROCESS)
         state->preprocess(strm);
 
+    if (state->stats)
+        state->stats->rsis++;
+    state->rsi_pending = 1;
     return m_check_zero_block(strm);
 }
 
@@ -696,6 +835,7 @@ static int m_get_block(struct aec_stream *strm)
     */
 
     struct internal_state *state = strm->state;
+    PROFILE_ENTER(state, P_m_get_block);
 
     init_output(strm);
 
@@ -706,15 +846,28 @@ static int m_get_block(struct aec_stream *strm)
     }
 
     if (state->blocks_avail == 0) {
+        if (state->rsi_callback) {
+            /* The previous RSI is complete */
+            if (state->rsi_pending)
+                report_rsi(strm);
+            state->rsi_start = out_bits(strm);
+        }
         state->blocks_avail = strm->rsi - 1;
         state->block = state->data_pp;
         state->blocks_dispensed = 1;
 
         if (strm->avail_in >= state->rsi_len) {
             state->get_rsi(strm);
+            if (state->pad_scanline) {
+                state->i = state->scanline;
+                pad_scanline(strm);
+            }
             if (strm->flags & AEC_DATA_PREPROCESS)
                 state->preprocess(strm);
 
+            if (state->stats)
+                state->stats->rsis++;
+            state->rsi_pending = 1;
             return m_check_zero_block(strm);
         } else {
             state->i = 0;
@@ -744,42 +897,303 @@ static void cleanup(struct aec_stream *strm)
     free(state);
 }
 
-/*
- *
- * API functions
- *
- */
+static void start_output(struct aec_stream *strm, uint8_t *out, size_t len)
+{
+    struct internal_state *state = strm->state;
 
-int aec_encode_init(struct aec_stream *strm)
+    strm->next_out = out;
+    strm->avail_out = len;
+    state->cds = state->cds_buf;
+    *state->cds = 0;
+    state->bits = 8;
+    state->direct_out = 0;
+}
+
+static void end_direct_output(struct aec_stream *strm)
 {
-    struct internal_state *state;
+    /**
+       Move the partially filled last byte from next_out to cds_buf
+       so that the user can hand in a new output buffer.
+    */
 
-    if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
-        return AEC_CONF_ERROR;
+    struct internal_state *state = strm->state;
 
-    if (strm->flags & AEC_NOT_ENFORCE) {
-        /* All even block sizes are allowed. */
-        if (strm->block_size & 1)
-            return AEC_CONF_ERROR;
-    } else {
-        /* Only allow standard conforming block sizes */
-        if (strm->block_size != 8
-            && strm->block_size != 16
-            && strm->block_size != 32
-            && strm->block_size != 64)
-            return AEC_CONF_ERROR;
+    if (state->direct_out) {
+        int n = (int)(state->cds - strm->next_out);
+        strm->next_out += n;
+        strm->avail_out -= n;
+
+        *state->cds_buf = *state->cds;
+        state->cds = state->cds_buf;
+        state->direct_out = 0;
     }
+}
 
-    if (strm->rsi > 4096)
-        return AEC_CONF_ERROR;
+static inline uint8_t bitstream_byte(const uint8_t *src, int o, size_t i)
+{
+    return o ? (uint8_t)(src[i] << o | src[i + 1] >> (8 - o)) : src[i];
+}
 
-    state = malloc(sizeof(struct internal_state));
-    if (state == NULL)
-        return AEC_MEM_ERROR;
+static void emit_bitstream(struct aec_stream *strm, const uint8_t *src,
+                           size_t first, size_t nbits)
+{
+    /**
+       Append nbits bits from src starting at bit first to the
+       output. Like emit(), the last byte stays in cds even if it is
+       full. The caller makes sure that next_out can hold all bytes
+       before it.
+    */
 
-    memset(state, 0, sizeof(struct internal_state));
+    struct internal_state *state = strm->state;
+    int used = 8 - state->bits;
+    int o = (int)(first % 8);
+    size_t n = (used + nbits - 1) / 8;
+    size_t last = (nbits - 1) / 8;
+    uint8_t mask = (uint8_t)(0xff << (8 * (last + 1) - nbits));
+    uint8_t acc = *state->cds;
+    uint8_t b;
+
+    if (nbits == 0)
+        return;
+
+    src += first / 8;
+    for (size_t i = 0; i < n; i++) {
+        b = bitstream_byte(src, o, i);
+        if (i == last)
+            b &= mask;
+        strm->next_out[i] = acc | (uint8_t)(b >> used);
+        acc = (uint8_t)(b << (8 - used));
+    }
+    if (n <= last)
+        acc |= (uint8_t)((bitstream_byte(src, o, n) & mask) >> used);
+
+    strm->next_out += n;
+    strm->avail_out -= n;
+    *state->cds = acc;
+    state->bits = (int)(8 * (n + 1) - used - nbits);
+}
+
+struct encode_group {
+    /* copy of the stream with its own state */
+    struct aec_stream strm;
+    struct internal_state *master;
+
+    /* whole RSIs of this group */
+    const unsigned char *next_in;
+    size_t rsis;
+
+    /* 1 if the RSI before next_in is encoded first to get k */
+    int warm_up;
+    int k_start;
+
+    /* bit stream of the group. RSI r starts at bit pos[r] and
+     * leaves k[r] behind */
+    uint8_t *out;
+    size_t *pos;
+    int *k;
+    int status;
+};
+
+static void encode_group(void *arg)
+{
+    /**
+       Encode the RSIs of a group into a buffer of its own.
+
+       RSIs are independent apart from the k where the search for
+       the splitting position starts. Unless the group starts at the
+       beginning, the preceding RSI is encoded first to get a k which
+       is likely the one a single thread would have. The caller has
+       to check k_start and encode RSIs again until k agrees if it
+       was wrong.
+    */
+
+    struct encode_group *g = arg;
+    struct aec_stream *strm = &g->strm;
+    struct internal_state *state;
+    size_t rsi_samples = strm->rsi * strm->block_size;
+    size_t len = (g->rsis * strm->rsi
+                  * (g->master->id_len
+                     + strm->block_size * strm->bits_per_sample)) / 8
+        + CDSLEN + 2;
+
+    g->status = AEC_MEM_ERROR;
+    g->out = malloc(len);
+    g->pos = malloc((g->rsis + 1) * sizeof(size_t));
+    g->k = malloc(g->rsis * sizeof(int));
+    state = malloc(sizeof(struct internal_state));
+    if (g->out == NULL || g->pos == NULL || g->k == NULL
+        || state == NULL) {
+        free(state);
+        return;
+    }
+    *state = *g->master;
     strm->state = state;
+    state->data_pp = malloc(rsi_samples * sizeof(uint32_t));
+    if (strm->flags & AEC_DATA_PREPROCESS) {
+        state->data_raw = malloc(rsi_samples * sizeof(uint32_t));
+        if (state->data_raw == NULL) {
+            cleanup(strm);
+            return;
+        }
+    } else {
+        state->data_raw = state->data_pp;
+    }
+    if (state->data_pp == NULL) {
+        cleanup(strm);
+        return;
+    }
+
+    state->flush = AEC_NO_FLUSH;
+    state->k = g->k_start;
+    if (g->warm_up) {
+        start_output(strm, g->out, len);
+        strm->next_in = g->next_in - state->rsi_len;
+        strm->avail_in = state->rsi_len;
+        state->mode = m_get_block;
+        state->blocks_avail = 0;
+        while (state->mode(strm) == M_CONTINUE);
+        g->k_start = state->k;
+    }
+
+    /* The output buffer is large enough for direct output
+     * throughout, cds always points into it. */
+    start_output(strm, g->out, len);
+    strm->next_in = g->next_in;
+    strm->avail_in = 0;
+    g->pos[0] = 0;
+    for (size_t r = 0; r < g->rsis; r++) {
+        strm->avail_in = state->rsi_len;
+        state->mode = m_get_block;
+        state->blocks_avail = 0;
+        while (state->mode(strm) == M_CONTINUE);
+        g->pos[r + 1] = (state->cds - g->out) * 8 + 8 - state->bits;
+        g->k[r] = state->k;
+    }
+    end_direct_output(strm);
+    strm->next_out[0] = *state->cds;
+    strm->next_out[1] = 0;
+    g->status = AEC_OK;
+    cleanup(strm);
+}
+
+static int encode_rsi(struct aec_stream *strm)
+{
+    /**
+       Encode the next RSI with the FSM. Returns 0 if the output
+       buffer is full before the RSI is done.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t avail_in = strm->avail_in;
+
+    strm->avail_in = state->rsi_len;
+    state->mode = m_get_block;
+    state->blocks_avail = 0;
+    while (state->mode(strm) == M_CONTINUE);
+    PROFILE_LEAVE(state);
+    strm->avail_in += avail_in - state->rsi_len;
+    return state->mode == m_get_rsi_resumable && state->i == 0;
+}
+
+static void encode_parallel(struct aec_stream *strm)
+{
+    /**
+       Encode the whole RSIs in the input in groups, one per thread,
+       and concatenate the bit streams of the groups. The result is
+       identical to single threaded encoding.
+
+       Groups which fail or don't fit into the output buffer are left
+       to the single threaded FSM.
+    */
+
+    struct internal_state *state = strm->state;
+    struct encode_group *groups;
+    size_t rsis = strm->avail_in / state->rsi_len;
+    size_t n = MIN((size_t)state->threads,
+                   rsis * state->scanline / GROUP_SAMPLES);
+    size_t first = 0;
+    int flush = state->flush;
+
+    n = MIN(n, rsis);
+    if (n < 2)
+        return;
+    groups = malloc(n * sizeof(struct encode_group));
+    if (groups == NULL)
+        return;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t last = rsis * (i + 1) / n;
+        groups[i].strm = *strm;
+        groups[i].master = state;
+        groups[i].next_in = strm->next_in + first * state->rsi_len;
+        groups[i].rsis = last - first;
+        groups[i].warm_up = i > 0;
+        groups[i].k_start = state->k;
+        first = last;
+    }
+    aec_run_tasks(encode_group, groups, sizeof(struct encode_group),
+                  (int)n);
+
+    /* Stop the FSM from finishing the stream when it runs out of
+     * input after an RSI. */
+    state->flush = AEC_NO_FLUSH;
+    for (size_t i = 0; i < n; i++) {
+        struct encode_group *g = &groups[i];
+        size_t r = 0;
+        size_t bits;
+
+        if (g->status != AEC_OK)
+            break;
+
+        if (g->k_start != state->k) {
+            /* Wrong guess. Encode RSIs here until k is the same as
+             * in the group. */
+            do {
+                if (!encode_rsi(strm))
+                    goto exit;
+            } while (state->k != g->k[r++] && r < g->rsis);
+            end_direct_output(strm);
+        }
+
+        if (r == g->rsis)
+            continue;
+        bits = g->pos[g->rsis] - g->pos[r];
+        if ((8 - state->bits + bits - 1) / 8 > strm->avail_out)
+            break;
+        emit_bitstream(strm, g->out, g->pos[r], bits);
+        state->k = g->k[g->rsis - 1];
+        strm->next_in += (g->rsis - r) * state->rsi_len;
+        strm->avail_in -= (g->rsis - r) * state->rsi_len;
+        state->mode = m_get_block;
+        state->blocks_avail = 0;
+    }
+exit:
+    state->flush = flush;
+    for (size_t i = 0; i < n; i++) {
+        free(groups[i].out);
+        free(groups[i].pos);
+        free(groups[i].k);
+    }
+    free(groups);
+}
+
+/*
+ *
+ * API functions
+ *
+ */
+
+static int setup_state(struct aec_stream *strm)
+{
+    /**
+       Derive the coder configuration from the stream parameters.
+       Buffers already present in the zeroed state are reused.
+    */
+
+    struct internal_state *state = strm->state;
+
     state->uncomp_len = strm->block_size * strm->bits_per_sample;
+    state->scanline = strm->rsi * strm->block_size;
 
     if (strm->bits_per_sample > 16) {
         /* 24/32 input bit settings */
@@ -837,7 +1251,7 @@ int aec_encode_init(struct aec_stream *strm)
         state->get_sample = aec_get_8;
         state->get_rsi = aec_get_rsi_8;
     }
-    state->rsi_len = strm->rsi * strm->block_size * state->bytes_per_sample;
+    state->rsi_len = state->scanline * state->bytes_per_sample;
 
     if (strm->flags & AEC_DATA_SIGNED) {
         state->xmax = (INT64_C(1) << (strm->bits_per_sample - 1)) - 1;
@@ -851,21 +1265,25 @@ int aec_encode_init(struct aec_stream *strm)
 
     state->kmax = (1U << state->id_len) - 3;
 
-    state->data_pp = malloc(strm->rsi
-                            * strm->block_size
-                            * sizeof(uint32_t));
     if (state->data_pp == NULL) {
-        cleanup(strm);
-        return AEC_MEM_ERROR;
+        state->data_pp = malloc(strm->rsi
+                                * strm->block_size
+                                * sizeof(uint32_t));
+        if (state->data_pp == NULL) {
+            cleanup(strm);
+            return AEC_MEM_ERROR;
+        }
     }
 
     if (strm->flags & AEC_DATA_PREPROCESS) {
-        state->data_raw = malloc(strm->rsi
-                                 * strm->block_size
-                                 * sizeof(uint32_t));
         if (state->data_raw == NULL) {
-            cleanup(strm);
-            return AEC_MEM_ERROR;
+            state->data_raw = malloc(strm->rsi
+                                     * strm->block_size
+                                     * sizeof(uint32_t));
+            if (state->data_raw == NULL) {
+                cleanup(strm);
+                return AEC_MEM_ERROR;
+            }
         }
     } else {
         state->data_raw = state->data_pp;
@@ -886,6 +1304,171 @@ int aec_encode_init(struct aec_stream *strm)
     return AEC_OK;
 }
 
+int aec_encode_init(struct aec_stream *strm)
+{
+    struct internal_state *state;
+
+    if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
+        return AEC_CONF_ERROR;
+
+    if (strm->flags & AEC_NOT_ENFORCE) {
+        /* All even block sizes are allowed. */
+        if (strm->block_size & 1)
+            return AEC_CONF_ERROR;
+    } else {
+        /* Only allow standard conforming block sizes */
+        if (strm->block_size != 8
+            && strm->block_size != 16
+            && strm->block_size != 32
+            && strm->block_size != 64)
+            return AEC_CONF_ERROR;
+    }
+
+    if (strm->rsi > 4096)
+        return AEC_CONF_ERROR;
+
+    state = malloc(sizeof(struct internal_state));
+    if (state == NULL)
+        return AEC_MEM_ERROR;
+
+    memset(state, 0, sizeof(struct internal_state));
+    strm->state = state;
+    return setup_state(strm);
+}
+
+int aec_encode_set_stride(struct aec_stream *strm, size_t stride)
+{
+    /**
+       Read samples which are stride bytes apart.
+
+       The strided accessors are selected by the storage size which
+       was set up by aec_encode_init().
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t size = state->bytes_per_sample - state->stride_gap;
+    int msb = strm->flags & AEC_DATA_MSB;
+
+    if (stride < size
+        || stride > UINT32_MAX / (strm->rsi * strm->block_size))
+        return AEC_CONF_ERROR;
+
+    if (size == 4) {
+        state->get_sample = msb ? aec_get_strided_msb_32
+            : aec_get_strided_lsb_32;
+        state->get_rsi = msb ? aec_get_rsi_strided_msb_32
+            : aec_get_rsi_strided_lsb_32;
+    } else if (size == 3) {
+        state->get_sample = msb ? aec_get_strided_msb_24
+            : aec_get_strided_lsb_24;
+        state->get_rsi = msb ? aec_get_rsi_strided_msb_24
+            : aec_get_rsi_strided_lsb_24;
+    } else if (size == 2) {
+        state->get_sample = msb ? aec_get_strided_msb_16
+            : aec_get_strided_lsb_16;
+        state->get_rsi = msb ? aec_get_rsi_strided_msb_16
+            : aec_get_rsi_strided_lsb_16;
+    } else {
+        state->get_sample = aec_get_strided_8;
+        state->get_rsi = aec_get_rsi_strided_8;
+    }
+
+    state->bytes_per_sample = (uint32_t)stride;
+    state->stride_gap = (uint32_t)stride - size;
+    state->rsi_len = state->scanline * state->bytes_per_sample;
+    return AEC_OK;
+}
+
+int aec_encode_set_planes(struct aec_stream *strm, size_t wordsize,
+                          size_t words)
+{
+    /**
+       Read byte planes of the words at next_in.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (state->bytes_per_sample != 1 || state->get_rsi != aec_get_rsi_8
+        || wordsize == 0)
+        return AEC_CONF_ERROR;
+
+    if (words == 0)
+        return AEC_OK;
+
+    state->planes_base = strm->next_in;
+    state->plane_len = words;
+    state->wordsize = wordsize;
+    state->get_sample = aec_get_plane;
+    state->get_rsi = aec_get_rsi_plane;
+    return AEC_OK;
+}
+
+int aec_encode_set_scanline(struct aec_stream *strm, size_t samples,
+                            int pad)
+{
+    /**
+       Take scanlines of samples from the input and pad each of them
+       to a full RSI.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (samples == 0 || samples > strm->rsi * strm->block_size)
+        return AEC_CONF_ERROR;
+
+    state->scanline = (uint32_t)samples;
+    state->pad_scanline = 1;
+    state->pad_zero = pad == AEC_PAD_ZERO;
+    state->rsi_len = state->scanline * state->bytes_per_sample;
+    return AEC_OK;
+}
+
+int aec_encode_set_threads(struct aec_stream *strm, int threads)
+{
+    /**
+       Encode whole RSIs in the input on up to threads threads.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (threads < 0)
+        return AEC_CONF_ERROR;
+    if (threads == 0)
+        threads = aec_cpu_count();
+    state->threads = MIN(threads, AEC_MAX_THREADS);
+    return AEC_OK;
+}
+
+int aec_encode_set_stats(struct aec_stream *strm, struct aec_stats *stats)
+{
+    /**
+       Count code options in stats from now on.
+    */
+
+    struct internal_state *state = strm->state;
+
+    if (stats)
+        memset(stats, 0, sizeof(struct aec_stats));
+    state->stats = stats;
+    return AEC_OK;
+}
+
+int aec_encode_set_rsi_callback(struct aec_stream *strm,
+                                void (*callback)(void *opaque,
+                                                 const struct aec_rsi *rsi),
+                                void *opaque)
+{
+    /**
+       Call callback whenever an RSI is coded.
+    */
+
+    struct internal_state *state = strm->state;
+
+    state->rsi_callback = callback;
+    state->rsi_opaque = opaque;
+    return AEC_OK;
+}
+
 int aec_encode(struct aec_stream *strm, int flush)
 {
     /**
@@ -898,17 +1481,41 @@ int aec_encode(struct aec_stream *strm, int flush)
     strm->total_in += strm->avail_in;
     strm->total_out += strm->avail_out;
 
-    while (state->mode(strm) == M_CONTINUE);
+    if (state->stride_gap) {
+        /* Skip what is left of the gap behind the last sample of
+         * the previous call. */
+        size_t skip = MIN(state->stride_skip, strm->avail_in);
+        strm->next_in += skip;
+        strm->avail_in -= skip;
+        state->stride_skip -= (uint32_t)skip;
+
+        /* The last sample of strided input doesn't need a full
+         * stride. Pretend it does while the FSM is running. */
+        strm->avail_in += state->stride_gap;
+    }
 
-    if (state->direct_out) {
-        int n = (int)(state->cds - strm->next_out);
-        strm->next_out += n;
-        strm->avail_out -= n;
+    if (state->threads > 1 && state->stats == NULL
+        && state->rsi_callback == NULL
+        && state->zero_blocks == 0
+        && !state->block_nonzero
+        && ((state->mode == m_get_block && state->blocks_avail == 0)
+            || (state->mode == m_get_rsi_resumable && state->i == 0)))
+        encode_parallel(strm);
 
-        *state->cds_buf = *state->cds;
-        state->cds = state->cds_buf;
-        state->direct_out = 0;
+    while (state->mode(strm) == M_CONTINUE);
+    PROFILE_LEAVE(state);
+
+    if (state->stride_gap) {
+        if (strm->avail_in >= state->stride_gap) {
+            strm->avail_in -= state->stride_gap;
+        } else {
+            state->stride_skip = state->stride_gap - (uint32_t)strm->avail_in;
+            strm->next_in -= state->stride_skip;
+            strm->avail_in = 0;
+        }
     }
+
+    end_direct_output(strm);
     strm->total_in -= strm->avail_in;
     strm->total_out -= strm->avail_out;
     return AEC_OK;
@@ -921,10 +1528,45 @@ int aec_encode_end(struct aec_stream *strm)
     int status = AEC_OK;
     if (state->flush == AEC_FLUSH && state->flushed == 0)
         status = AEC_STREAM_ERROR;
+#if ENABLE_PROFILE
+    aec_profile_dump(&state->profile, "encoder", profile_names, P_STATES);
+#endif
     cleanup(strm);
     return status;
 }
 
+int aec_encode_reset(struct aec_stream *strm)
+{
+    /**
+       Same as aec_encode_end() followed by aec_encode_init() with
+       unchanged parameters, but the buffers are kept.
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t *data_pp = state->data_pp;
+    uint32_t *data_raw = state->data_raw;
+    int status = AEC_OK;
+#if ENABLE_PROFILE
+    /* The profile adds up over all streams */
+    struct aec_profile profile = state->profile;
+#endif
+
+    if (state->flush == AEC_FLUSH && state->flushed == 0)
+        status = AEC_STREAM_ERROR;
+
+    memset(state, 0, sizeof(struct internal_state));
+    state->data_pp = data_pp;
+    state->data_raw = data_raw;
+#if ENABLE_PROFILE
+    state->profile = profile;
+#endif
+    if (status == AEC_OK)
+        status = setup_state(strm);
+    else
+        setup_state(strm);
+    return status;
+}
+
 int aec_buffer_encode(struct aec_stream *strm)
 {
     int status = aec_encode_init(strm);
@@ -937,3 +1579,159 @@ int aec_buffer_encode(struct aec_stream *strm)
     }
     return aec_encode_end(strm);
 }
+
+static double scale_factor(double base, int e)
+{
+    /**
+       base^e by repeated squaring. Avoids a dependency on libm.
+    */
+
+    double f = 1.0;
+    unsigned int n = e < 0 ? -(unsigned int)e : (unsigned int)e;
+
+    while (n) {
+        if (n & 1)
+            f *= base;
+        base *= base;
+        n >>= 1;
+    }
+    return e < 0 ? 1.0 / f : f;
+}
+
+static int buffer_encode_quantized(struct aec_stream *strm,
+                                   const void *source, size_t n,
+                                   int double_precision,
+                                   double reference,
+                                   int binary_scale,
+                                   int decimal_scale)
+{
+    /**
+       Buffer encoding of floats or doubles. The input accessors
+       quantise directly into data_raw.
+    */
+
+    struct internal_state *state;
+    int status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    state = strm->state;
+    state->reference = reference;
+    state->decimal = scale_factor(10.0, decimal_scale);
+    state->divisor = scale_factor(2.0, -binary_scale);
+
+    if (double_precision) {
+        state->bytes_per_sample = sizeof(double);
+        state->get_sample = aec_get_double;
+        state->get_rsi = aec_get_rsi_double;
+    } else {
+        state->bytes_per_sample = sizeof(float);
+        state->get_sample = aec_get_float;
+        state->get_rsi = aec_get_rsi_float;
+    }
+    state->rsi_len = state->scanline * state->bytes_per_sample;
+
+    strm->next_in = source;
+    strm->avail_in = n * state->bytes_per_sample;
+
+    status = aec_encode(strm, AEC_FLUSH);
+    if (status != AEC_OK) {
+        cleanup(strm);
+        return status;
+    }
+    return aec_encode_end(strm);
+}
+
+int aec_encode_float(struct aec_stream *strm,
+                     const float *source, size_t n,
+                     double reference, int binary_scale, int decimal_scale)
+{
+    return buffer_encode_quantized(strm, source, n, 0, reference,
+                                   binary_scale, decimal_scale);
+}
+
+int aec_encode_double(struct aec_stream *strm,
+                      const double *source, size_t n,
+                      double reference, int binary_scale, int decimal_scale)
+{
+    return buffer_encode_quantized(strm, source, n, 1, reference,
+                                   binary_scale, decimal_scale);
+}
+
+static int buffer_encode_native(struct aec_stream *strm,
+                                const void *source, size_t n,
+                                uint32_t size, int is_signed)
+{
+    /**
+       Buffer encoding of host integers of size bytes.
+    */
+
+    struct internal_state *state;
+    int status;
+
+    if (strm->bits_per_sample > 8 * size)
+        return AEC_CONF_ERROR;
+
+    if (is_signed)
+        strm->flags |= AEC_DATA_SIGNED;
+    else
+        strm->flags &= ~AEC_DATA_SIGNED;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    state = strm->state;
+    if (size == 4) {
+        state->get_sample = aec_get_native_32;
+        state->get_rsi = aec_get_rsi_native_32;
+    } else if (size == 2) {
+        state->get_sample = aec_get_native_16;
+        state->get_rsi = aec_get_rsi_native_16;
+    } else {
+        state->get_sample = aec_get_native_8;
+        state->get_rsi = aec_get_rsi_native_8;
+    }
+    state->bytes_per_sample = size;
+    state->rsi_len = state->scanline * state->bytes_per_sample;
+
+    strm->next_in = source;
+    strm->avail_in = n * size;
+
+    status = aec_encode(strm, AEC_FLUSH);
+    if (status != AEC_OK) {
+        cleanup(strm);
+        return status;
+    }
+    return aec_encode_end(strm);
+}
+
+int aec_encode_u8(struct aec_stream *strm, const uint8_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 1, 0);
+}
+
+int aec_encode_u16(struct aec_stream *strm, const uint16_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 2, 0);
+}
+
+int aec_encode_u32(struct aec_stream *strm, const uint32_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 4, 0);
+}
+
+int aec_encode_i8(struct aec_stream *strm, const int8_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 1, 1);
+}
+
+int aec_encode_i16(struct aec_stream *strm, const int16_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 2, 1);
+}
+
+int aec_encode_i32(struct aec_stream *strm, const int32_t *source, size_t n)
+{
+    return buffer_encode_native(strm, source, n, 4, 1);
+}
@@ -40,7 +40,9 @@
 #define ENCODE_H 1
 
 #include "config.h"
+#include "profile.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #define M_CONTINUE 1
 #define M_EXIT 0
@@ -54,6 +56,8 @@
 #define ROS -1
 
 struct aec_stream;
+struct aec_stats;
+struct aec_rsi;
 
 struct internal_state {
     int (*mode)(struct aec_stream *);
@@ -87,9 +91,20 @@ struct internal_state {
     /* current (preprocessed) input block */
     uint32_t *block;
 
-    /* reference sample interval in byte */
+    /* input of one reference sample interval in byte */
     uint32_t rsi_len;
 
+    /* input samples per RSI. Less than rsi * block_size if
+     * scanlines are padded */
+    uint32_t scanline;
+
+    /* 1 if every RSI is a scanline padded by the encoder */
+    int pad_scanline;
+
+    /* 1 if scanlines are padded with zero instead of their last
+     * sample */
+    int pad_zero;
+
     /* current Coded Data Set output */
     uint8_t *cds;
 
@@ -116,12 +131,23 @@ struct internal_state {
     /* reference sample of zero block */
     uint32_t zero_ref_sample;
 
-    /* storage size of samples in bytes */
+    /* input bytes per sample. Storage size of samples or stride if
+     * input is strided */
     uint32_t bytes_per_sample;
 
+    /* bytes between the end of a sample and the next sample in
+     * strided input */
+    uint32_t stride_gap;
+
+    /* gap bytes still to be skipped at the start of the next call */
+    uint32_t stride_skip;
+
     /* number of contiguous zero blocks */
     int zero_blocks;
 
+    /* length of a zero block run coded as ROS */
+    int ros_blocks;
+
     /* 1 if this is the first non-zero block after one or more zero
      * blocks */
     int block_nonzero;
@@ -140,6 +166,39 @@ struct internal_state {
 
     /* length of uncompressed CDS */
     uint32_t uncomp_len;
+
+    /* byte planes of words: input is read as byte 0 of all words,
+     * then byte 1 and so on */
+    const unsigned char *planes_base;
+    size_t plane_len;
+    size_t wordsize;
+
+    /* number of threads for whole RSIs in the input */
+    int threads;
+
+    /* caller owned statistics or NULL */
+    struct aec_stats *stats;
+
+    /* RSI callback or NULL and its argument */
+    void (*rsi_callback)(void *, const struct aec_rsi *);
+    void *rsi_opaque;
+
+    /* number and output bit position of the current RSI, 1 if it
+     * has not been reported yet */
+    size_t rsi_index;
+    uint64_t rsi_start;
+    int rsi_pending;
+
+    /* quantisation of floating point input:
+     * (x * decimal - reference) * divisor */
+    double reference;
+    double decimal;
+    double divisor;
+
+#if ENABLE_PROFILE
+    /* time spent in the FSM states */
+    struct aec_profile profile;
+#endif
 };
 
 #endif /* ENCODE_H */
@@ -118,7 +118,7 @@ void aec_get_rsi_8(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     unsigned const char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = (uint32_t)in[i];
@@ -131,7 +131,7 @@ void aec_get_rsi_lsb_16(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = (uint32_t)in[2 * i] | ((uint32_t)in[2 * i + 1] << 8);
@@ -144,7 +144,7 @@ void aec_get_rsi_msb_16(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = ((uint32_t)in[2 * i] << 8) | (uint32_t)in[2 * i + 1];
@@ -157,7 +157,7 @@ void aec_get_rsi_lsb_24(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = (uint32_t)in[3 * i]
@@ -172,7 +172,7 @@ void aec_get_rsi_msb_24(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = ((uint32_t)in[3 * i] << 16)
@@ -186,7 +186,7 @@ void aec_get_rsi_msb_24(struct aec_stream *strm)
 #define AEC_GET_RSI_NATIVE_32(BO)                       \
     void aec_get_rsi_##BO##_32(struct aec_stream *strm) \
     {                                               \
-        int rsi = strm->rsi * strm->block_size;     \
+        int rsi = strm->state->scanline;     \
         memcpy(strm->state->data_raw,               \
                strm->next_in, 4 * rsi);             \
         strm->next_in += 4 * rsi;                   \
@@ -198,7 +198,7 @@ void aec_get_rsi_lsb_32(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     for (int i = 0; i < rsi; i++)
         out[i] = (uint32_t)in[4 * i]
@@ -217,7 +217,7 @@ void aec_get_rsi_msb_32(struct aec_stream *strm)
 {
     uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    int rsi = strm->state->scanline;
 
     strm->next_in += 4 * rsi;
     strm->avail_in -= 4 * rsi;
@@ -232,3 +232,248 @@ void aec_get_rsi_msb_32(struct aec_stream *strm)
 AEC_GET_RSI_NATIVE_32(lsb)
 
 #endif /* !WORDS_BIGENDIAN */
+
+static inline uint32_t load_8(const unsigned char *p)
+{
+    return (uint32_t)p[0];
+}
+
+static inline uint32_t load_lsb_16(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t load_msb_16(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 8) | (uint32_t)p[1];
+}
+
+static inline uint32_t load_lsb_24(const unsigned char *p)
+{
+    return (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t load_msb_24(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 16)
+        | ((uint32_t)p[1] << 8)
+        | (uint32_t)p[2];
+}
+
+static inline uint32_t load_lsb_32(const unsigned char *p)
+{
+    return (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t load_msb_32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24)
+        | ((uint32_t)p[1] << 16)
+        | ((uint32_t)p[2] << 8)
+        | (uint32_t)p[3];
+}
+
+/* Strided input. bytes_per_sample holds the stride. aec_encode()
+ * makes sure that the last sample only needs its storage size. */
+#define AEC_GET_STRIDED(KIND)                                       \
+    uint32_t aec_get_strided_##KIND(struct aec_stream *strm)        \
+    {                                                               \
+        uint32_t stride = strm->state->bytes_per_sample;            \
+        uint32_t data = load_##KIND(strm->next_in);                 \
+                                                                    \
+        strm->next_in += stride;                                    \
+        strm->avail_in -= stride;                                   \
+        return data;                                                \
+    }                                                               \
+                                                                    \
+    void aec_get_rsi_strided_##KIND(struct aec_stream *strm)        \
+    {                                                               \
+        uint32_t *restrict out = strm->state->data_raw;             \
+        const unsigned char *restrict in = strm->next_in;           \
+        size_t stride = strm->state->bytes_per_sample;              \
+        int rsi = strm->state->scanline;                     \
+                                                                    \
+        for (int i = 0; i < rsi; i++)                               \
+            out[i] = load_##KIND(in + i * stride);                  \
+                                                                    \
+        strm->next_in += rsi * stride;                              \
+        strm->avail_in -= rsi * stride;                             \
+    }
+
+AEC_GET_STRIDED(8)
+AEC_GET_STRIDED(lsb_16)
+AEC_GET_STRIDED(msb_16)
+AEC_GET_STRIDED(lsb_24)
+AEC_GET_STRIDED(msb_24)
+AEC_GET_STRIDED(lsb_32)
+AEC_GET_STRIDED(msb_32)
+
+#define AEC_GET_NATIVE(BITS)                                        \
+    uint32_t aec_get_native_##BITS(struct aec_stream *strm)         \
+    {                                                               \
+        uint##BITS##_t x;                                           \
+                                                                    \
+        memcpy(&x, strm->next_in, sizeof(x));                       \
+        strm->next_in += sizeof(x);                                 \
+        strm->avail_in -= sizeof(x);                                \
+        return x & (UINT32_MAX >> (32 - strm->bits_per_sample));    \
+    }                                                               \
+                                                                    \
+    void aec_get_rsi_native_##BITS(struct aec_stream *strm)         \
+    {                                                               \
+        uint32_t *restrict out = strm->state->data_raw;             \
+        const unsigned char *restrict in = strm->next_in;           \
+        uint32_t mask = UINT32_MAX >> (32 - strm->bits_per_sample); \
+        int rsi = strm->state->scanline;                     \
+                                                                    \
+        for (int i = 0; i < rsi; i++) {                             \
+            uint##BITS##_t x;                                       \
+            memcpy(&x, in + i * sizeof(x), sizeof(x));              \
+            out[i] = x & mask;                                      \
+        }                                                           \
+                                                                    \
+        strm->next_in += rsi * sizeof(uint##BITS##_t);              \
+        strm->avail_in -= rsi * sizeof(uint##BITS##_t);             \
+    }
+
+AEC_GET_NATIVE(8)
+AEC_GET_NATIVE(16)
+AEC_GET_NATIVE(32)
+
+/* Byte planes. next_in runs through the virtual concatenation of
+ * byte planes. Position p maps to byte p / plane_len of word
+ * p % plane_len. Bytes after the last full word are read as is. */
+
+uint32_t aec_get_plane(struct aec_stream *strm)
+{
+    struct internal_state *state = strm->state;
+    size_t p = strm->next_in - state->planes_base;
+    size_t n = state->plane_len;
+
+    if (p < n * state->wordsize)
+        p = (p % n) * state->wordsize + p / n;
+
+    strm->next_in++;
+    strm->avail_in--;
+    return state->planes_base[p];
+}
+
+void aec_get_rsi_plane(struct aec_stream *strm)
+{
+    struct internal_state *state = strm->state;
+    uint32_t *restrict out = state->data_raw;
+    const unsigned char *base = state->planes_base;
+    size_t w = state->wordsize;
+    size_t n = state->plane_len;
+    size_t p = strm->next_in - base;
+    size_t rsi = state->scanline;
+    size_t k = 0;
+
+    while (k < rsi && p + k < n * w) {
+        /* Run within one plane */
+        size_t i = (p + k) % n;
+        size_t j = (p + k) / n;
+        size_t run = MIN(n - i, rsi - k);
+        const unsigned char *restrict in = base + i * w + j;
+
+        for (size_t r = 0; r < run; r++)
+            out[k + r] = in[r * w];
+        k += run;
+    }
+    for (; k < rsi; k++)
+        out[k] = base[p + k];
+
+    strm->next_in += rsi;
+    strm->avail_in -= rsi;
+}
+
+struct quantizer {
+    double reference;
+    double decimal;
+    double divisor;
+    double qmin;
+    double qmax;
+    uint32_t mask;
+};
+
+static inline void quantizer_init(struct aec_stream *strm,
+                                  struct quantizer *q)
+{
+    /**
+       Copy the quantisation parameters and the range of the samples
+       once per call so that the loops below keep them in registers.
+    */
+
+    struct internal_state *state = strm->state;
+
+    q->reference = state->reference;
+    q->decimal = state->decimal;
+    q->divisor = state->divisor;
+    if (strm->flags & AEC_DATA_SIGNED) {
+        q->qmin = -(double)state->xmax - 1.0;
+        q->qmax = (double)state->xmax;
+    } else {
+        q->qmin = 0.0;
+        q->qmax = (double)state->xmax;
+    }
+    q->mask = UINT32_MAX >> (32 - strm->bits_per_sample);
+}
+
+static inline uint32_t quantize(const struct quantizer *q, double x)
+{
+    /**
+       Scale x and round to the nearest integer in [qmin, qmax].
+
+       NaN ends up as qmin. The cast is only applied to non-negative
+       numbers so truncation equals rounding down.
+    */
+
+    double v = (x * q->decimal - q->reference) * q->divisor;
+
+    if (!(v > q->qmin))
+        v = q->qmin;
+    else if (v > q->qmax)
+        v = q->qmax;
+
+    return (uint32_t)((int64_t)(v - q->qmin + 0.5) + (int64_t)q->qmin)
+        & q->mask;
+}
+
+#define AEC_GET_FLOAT(TYPE)                                         \
+    uint32_t aec_get_##TYPE(struct aec_stream *strm)                \
+    {                                                               \
+        TYPE x;                                                     \
+        struct quantizer q;                                         \
+                                                                    \
+        quantizer_init(strm, &q);                                   \
+        memcpy(&x, strm->next_in, sizeof(TYPE));                    \
+        strm->next_in += sizeof(TYPE);                              \
+        strm->avail_in -= sizeof(TYPE);                             \
+        return quantize(&q, x);                                     \
+    }                                                               \
+                                                                    \
+    void aec_get_rsi_##TYPE(struct aec_stream *strm)                \
+    {                                                               \
+        uint32_t *restrict out = strm->state->data_raw;             \
+        const unsigned char *restrict in = strm->next_in;           \
+        int rsi = strm->state->scanline;                            \
+        struct quantizer q;                                         \
+                                                                    \
+        quantizer_init(strm, &q);                                   \
+        for (int i = 0; i < rsi; i++) {                             \
+            TYPE x;                                                 \
+            memcpy(&x, in + i * sizeof(TYPE), sizeof(TYPE));        \
+            out[i] = quantize(&q, x);                               \
+        }                                                           \
+                                                                    \
+        strm->next_in += rsi * sizeof(TYPE);                        \
+        strm->avail_in -= rsi * sizeof(TYPE);                       \
+    }
+
+AEC_GET_FLOAT(float)
+AEC_GET_FLOAT(double)
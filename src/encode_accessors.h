@@ -58,4 +58,37 @@ void aec_get_rsi_msb_24(struct aec_stream *strm);
 void aec_get_rsi_lsb_32(struct aec_stream *strm);
 void aec_get_rsi_msb_32(struct aec_stream *strm);
 
+uint32_t aec_get_strided_8(struct aec_stream *strm);
+uint32_t aec_get_strided_lsb_16(struct aec_stream *strm);
+uint32_t aec_get_strided_msb_16(struct aec_stream *strm);
+uint32_t aec_get_strided_lsb_24(struct aec_stream *strm);
+uint32_t aec_get_strided_msb_24(struct aec_stream *strm);
+uint32_t aec_get_strided_lsb_32(struct aec_stream *strm);
+uint32_t aec_get_strided_msb_32(struct aec_stream *strm);
+
+void aec_get_rsi_strided_8(struct aec_stream *strm);
+void aec_get_rsi_strided_lsb_16(struct aec_stream *strm);
+void aec_get_rsi_strided_msb_16(struct aec_stream *strm);
+void aec_get_rsi_strided_lsb_24(struct aec_stream *strm);
+void aec_get_rsi_strided_msb_24(struct aec_stream *strm);
+void aec_get_rsi_strided_lsb_32(struct aec_stream *strm);
+void aec_get_rsi_strided_msb_32(struct aec_stream *strm);
+
+uint32_t aec_get_native_8(struct aec_stream *strm);
+uint32_t aec_get_native_16(struct aec_stream *strm);
+uint32_t aec_get_native_32(struct aec_stream *strm);
+
+void aec_get_rsi_native_8(struct aec_stream *strm);
+void aec_get_rsi_native_16(struct aec_stream *strm);
+void aec_get_rsi_native_32(struct aec_stream *strm);
+
+uint32_t aec_get_plane(struct aec_stream *strm);
+void aec_get_rsi_plane(struct aec_stream *strm);
+
+uint32_t aec_get_float(struct aec_stream *strm);
+uint32_t aec_get_double(struct aec_stream *strm);
+
+void aec_get_rsi_float(struct aec_stream *strm);
+void aec_get_rsi_double(struct aec_stream *strm);
+
 #endif /* ENCODE_ACCESSORS_H */
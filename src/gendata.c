@@ -0,0 +1,365 @@
+/**
+ * @file gendata.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Synthetic samples with controlled statistics for reproducible
+ * benchmarks. Random walks with Laplace distributed steps and
+ * independent geometric samples have a given mean after
+ * preprocessing or without it, so the code option and k can be
+ * chosen. Smooth 2-D fields, white noise and constant runs cover
+ * images, incompressible data and zero blocks. Several types are
+ * mixed in segments. The same seed gives the same samples.
+ *
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TYPES 16
+#define BUFFER_SAMPLES 4096
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct range {
+    int64_t lo;
+    int64_t hi;
+};
+
+struct generator {
+    const char *name;
+    double param;
+    uint32_t (*next)(struct generator *g, const struct range *r);
+
+    /* current value of walks and row and column of fields */
+    int64_t x;
+    size_t i;
+    size_t width;
+
+    /* sum of waves of the smooth field */
+    double amp;
+    double fx[4];
+    double fy[4];
+    double phase[4];
+};
+
+static uint64_t rng_state;
+
+static double uniform(void)
+{
+    /* xorshift64*, uniform in (0, 1) */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * UINT64_C(2685821657736338717) >> 11) + 0.5)
+        / 9007199254740992.0;
+}
+
+static int64_t geometric(double mean)
+{
+    /* Geometric distribution on 0, 1, ... with the given mean */
+    if (mean <= 0)
+        return 0;
+    return (int64_t)(log(uniform()) / log(mean / (mean + 1)));
+}
+
+static int64_t laplace(double mean)
+{
+    /* Difference whose preprocessed value 2|D| or 2|D| - 1 has
+     * about the given mean */
+    int64_t m;
+
+    if (mean <= 0)
+        return 0;
+    m = (int64_t)(log(uniform()) / log(1 - 2 / (mean + 2)));
+    return uniform() < 0.5 ? -m : m;
+}
+
+static int64_t reflect(int64_t x, const struct range *r)
+{
+    while (x < r->lo || x > r->hi) {
+        if (x > r->hi)
+            x = 2 * r->hi - x;
+        else
+            x = 2 * r->lo - x;
+    }
+    return x;
+}
+
+static int64_t clip(int64_t x, const struct range *r)
+{
+    if (x < r->lo)
+        return r->lo;
+    if (x > r->hi)
+        return r->hi;
+    return x;
+}
+
+static uint32_t next_laplace(struct generator *g, const struct range *r)
+{
+    /* Random walk, reflected at the limits of the range */
+    g->x = reflect(g->x + laplace(g->param), r);
+    return (uint32_t)g->x;
+}
+
+static uint32_t next_geometric(struct generator *g, const struct range *r)
+{
+    /* Independent samples. Unsigned ones are geometric from zero,
+     * signed ones Laplace distributed around zero. */
+    int64_t x = r->lo < 0 ? laplace(g->param) : geometric(g->param);
+    return (uint32_t)clip(x, r);
+}
+
+static uint32_t next_smooth(struct generator *g, const struct range *r)
+{
+    /* Sum of a few waves over rows of width samples plus Laplace
+     * noise. Neighbours differ by a few units at most. */
+    double col = (double)(g->i % g->width);
+    double row = (double)(g->i / g->width);
+    double v = 0;
+
+    for (int k = 0; k < 4; k++)
+        v += sin(g->fx[k] * col + g->fy[k] * row + g->phase[k]) / 4;
+    g->i++;
+    v = r->lo + (r->hi - r->lo) / 2 + g->amp * v;
+    return (uint32_t)clip((int64_t)floor(v) + laplace(g->param), r);
+}
+
+static uint32_t next_noise(struct generator *g, const struct range *r)
+{
+    (void)g;
+    return (uint32_t)(r->lo + (int64_t)(uniform() * (r->hi - r->lo + 1)));
+}
+
+static uint32_t next_zero(struct generator *g, const struct range *r)
+{
+    return (uint32_t)clip((int64_t)g->param, r);
+}
+
+static const struct generator types[] = {
+    {.name = "laplace", .param = 8, .next = next_laplace},
+    {.name = "geometric", .param = 8, .next = next_geometric},
+    {.name = "smooth", .param = 0.5, .next = next_smooth},
+    {.name = "noise", .param = 0, .next = next_noise},
+    {.name = "zero", .param = 0, .next = next_zero},
+};
+
+static int parse_types(char *pattern, struct generator *g, size_t width,
+                       const struct range *r)
+{
+    /**
+       Set up a generator for every TYPE[:PARAM] in the comma
+       separated pattern. Returns their number or 0 on error.
+    */
+
+    int n = 0;
+
+    for (char *s = strtok(pattern, ","); s; s = strtok(NULL, ",")) {
+        char *param = strchr(s, ':');
+        size_t t;
+
+        if (param)
+            *param++ = '\0';
+        for (t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+            if (strcmp(s, types[t].name) == 0)
+                break;
+        if (t == sizeof(types) / sizeof(types[0]) || n == MAX_TYPES) {
+            fprintf(stderr, "Unknown type %s\n", s);
+            return 0;
+        }
+        g[n] = types[t];
+        if (param)
+            g[n].param = atof(param);
+        g[n].x = r->lo + (r->hi - r->lo) / 2;
+        g[n].width = width;
+        /* Periods between 2/3 and 2 rows */
+        g[n].amp = 0.45 * (r->hi - r->lo);
+        if (g[n].amp > width / 4.0)
+            g[n].amp = width / 4.0;
+        for (int k = 0; k < 4; k++) {
+            g[n].fx[k] = 2 * M_PI * (0.5 + uniform()) / width;
+            g[n].fy[k] = 2 * M_PI * (0.5 + uniform()) / width;
+            g[n].phase[k] = 2 * M_PI * uniform();
+        }
+        n++;
+    }
+    return n;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [OPTION]... TYPE[:PARAM][,...] FILE\n",
+            name);
+    fprintf(stderr, "\nTypes:\n");
+    fprintf(stderr, "  laplace[:MEAN]    random walk, preprocessed samples"
+            " have mean MEAN (8)\n");
+    fprintf(stderr, "  geometric[:MEAN]  independent samples with mean"
+            " MEAN (8) for -N\n");
+    fprintf(stderr, "  smooth[:MEAN]     smooth 2-D field plus Laplace"
+            " noise of mean MEAN (0.5)\n");
+    fprintf(stderr, "  noise             uniform white noise\n");
+    fprintf(stderr, "  zero[:VALUE]      constant VALUE (0)\n");
+    fprintf(stderr, "Several types are mixed in segments picked at"
+            " random.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -n BITS  bits per sample (default 16)\n");
+    fprintf(stderr, "  -s       samples are signed\n");
+    fprintf(stderr, "  -m       samples are MSB first\n");
+    fprintf(stderr, "  -3       24 bit samples are stored in 3 bytes\n");
+    fprintf(stderr, "  -S N     samples (default 1048576)\n");
+    fprintf(stderr, "  -w N     row width of smooth fields (default 512)\n");
+    fprintf(stderr, "  -l N     samples per segment of a mix "
+            "(default 65536)\n");
+    fprintf(stderr, "  -r N     seed (default 1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct generator g[MAX_TYPES];
+    struct range r;
+    unsigned char *buf;
+    FILE *fp;
+    size_t samples = 1 << 20;
+    size_t width = 512;
+    size_t segment = 65536;
+    size_t size;
+    int bits = 16;
+    int sign = 0;
+    int msb = 0;
+    int three = 0;
+    int n_types;
+    int cur = 0;
+    int opt;
+
+    rng_state = 1;
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        char o = argv[opt][1];
+        if (o == 's') {
+            sign = 1;
+        } else if (o == 'm') {
+            msb = 1;
+        } else if (o == '3') {
+            three = 1;
+        } else if (o && strchr("nSwlr", o) && opt + 1 < argc) {
+            const char *v = argv[++opt];
+            if (o == 'n')
+                bits = atoi(v);
+            else if (o == 'S')
+                samples = (size_t)atol(v);
+            else if (o == 'w')
+                width = (size_t)atol(v);
+            else if (o == 'l')
+                segment = (size_t)atol(v);
+            else
+                rng_state = (uint64_t)atol(v);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - opt != 2 || bits < 1 || bits > 32 || width == 0
+        || segment == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The state of xorshift must not be zero */
+    rng_state = rng_state * UINT64_C(0x9e3779b97f4a7c15) + 1;
+
+    if (sign) {
+        r.hi = (INT64_C(1) << (bits - 1)) - 1;
+        r.lo = -r.hi - 1;
+    } else {
+        r.hi = (INT64_C(1) << bits) - 1;
+        r.lo = 0;
+    }
+    if (bits > 16)
+        size = bits <= 24 && three ? 3 : 4;
+    else
+        size = bits > 8 ? 2 : 1;
+
+    n_types = parse_types(argv[opt], g, width, &r);
+    if (n_types == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    buf = malloc(BUFFER_SAMPLES * size);
+    if (buf == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    fp = fopen(argv[opt + 1], "wb");
+    if (fp == NULL) {
+        perror(argv[opt + 1]);
+        free(buf);
+        return 1;
+    }
+
+    for (size_t i = 0; i < samples;) {
+        size_t n = samples - i < BUFFER_SAMPLES
+            ? samples - i : BUFFER_SAMPLES;
+
+        for (size_t j = 0; j < n; j++, i++) {
+            uint32_t u;
+
+            if (n_types > 1 && i % segment == 0)
+                cur = (int)(uniform() * n_types);
+            /* The encoder takes signed samples in the low bits
+             * only */
+            u = g[cur].next(&g[cur], &r)
+                & (UINT32_MAX >> (32 - bits));
+            for (size_t b = 0; b < size; b++) {
+                size_t k = msb ? size - 1 - b : b;
+                buf[j * size + k] = (unsigned char)(u >> (8 * b));
+            }
+        }
+        if (fwrite(buf, size, n, fp) != n) {
+            perror(argv[opt + 1]);
+            fclose(fp);
+            free(buf);
+            return 1;
+        }
+    }
+
+    free(buf);
+    if (fclose(fp)) {
+        perror(argv[opt + 1]);
+        return 1;
+    }
+    return 0;
+}
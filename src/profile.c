@@ -0,0 +1,72 @@
+/**
+ * @file profile.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Report of the time spent in the states of the encoder and
+ * decoder FSMs
+ *
+ */
+
+#include "config.h"
+#include "profile.h"
+
+#if ENABLE_PROFILE
+#include <inttypes.h>
+#include <stdio.h>
+
+void aec_profile_dump(const struct aec_profile *p, const char *coder,
+                      const char *const *names, int n)
+{
+    uint64_t total = 0;
+
+    for (int i = 1; i < n; i++)
+        total += p->ticks[i];
+    if (total == 0)
+        return;
+
+    fprintf(stderr, "libaec %s profile in %s\n", coder, PROFILE_UNIT);
+    fprintf(stderr, "%-24s %14s %16s %12s %8s\n",
+            "state", "calls", PROFILE_UNIT, "per call", "share");
+    for (int i = 1; i < n; i++) {
+        if (p->calls[i] == 0)
+            continue;
+        fprintf(stderr, "%-24s %14" PRIu64 " %16" PRIu64 " %12.1f %7.2f%%\n",
+                names[i], p->calls[i], p->ticks[i],
+                (double)p->ticks[i] / p->calls[i],
+                100.0 * p->ticks[i] / total);
+    }
+    fprintf(stderr, "%-24s %14s %16" PRIu64 "\n", "total", "", total);
+}
+#else
+/* ISO C forbids an empty translation unit */
+typedef int aec_profile_unused;
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file profile.h
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Time spent in the states of the encoder and decoder FSMs. Only
+ * compiled in if configured with AEC_PROFILE, the macros are empty
+ * otherwise.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H 1
+
+#include "config.h"
+
+#if ENABLE_PROFILE
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PROFILE_UNIT "cycles"
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILE_UNIT "cycles"
+#else
+#include <time.h>
+#define PROFILE_UNIT "ns"
+#endif
+
+#define PROFILE_MAX_STATES 24
+
+struct aec_profile {
+    /* state which is timed since start, 0 outside of the FSM */
+    int current;
+    uint64_t start;
+
+    /* entries and ticks per state */
+    uint64_t calls[PROFILE_MAX_STATES];
+    uint64_t ticks[PROFILE_MAX_STATES];
+};
+
+static inline uint64_t aec_profile_ticks(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    || defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void aec_profile_enter(struct aec_profile *p, int s)
+{
+    /* The time since the last state was entered is its own */
+    uint64_t t = aec_profile_ticks();
+
+    if (p->current)
+        p->ticks[p->current] += t - p->start;
+    p->current = s;
+    p->start = t;
+    p->calls[s]++;
+}
+
+static inline void aec_profile_leave(struct aec_profile *p)
+{
+    if (p->current)
+        p->ticks[p->current] += aec_profile_ticks() - p->start;
+    p->current = 0;
+}
+
+/* Print calls and ticks of states 1 to n - 1 to stderr */
+void aec_profile_dump(const struct aec_profile *p, const char *coder,
+                      const char *const *names, int n);
+
+#define PROFILE_ENTER(state, s) aec_profile_enter(&(state)->profile, (s))
+#define PROFILE_LEAVE(state) aec_profile_leave(&(state)->profile)
+#else
+#define PROFILE_ENTER(state, s) ((void)0)
+#define PROFILE_LEAVE(state) ((void)0)
+#endif
+
+#endif /* PROFILE_H */
@@ -41,8 +41,193 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #define NOPTS 129
-#define MIN(a, b) (((a) < (b))? (a): (b))
+
+/* Coder states kept by a thread for its next call with the same
+ * parameters. Buffers and tables are then reused instead of being
+ * allocated again for every chunk. */
+struct sz_cache {
+    struct aec_stream encoder;
+    struct aec_stream decoder;
+    int have_encoder;
+    int have_decoder;
+};
+
+static void free_cache(void *arg)
+{
+    struct sz_cache *cache = arg;
+
+    if (cache->have_encoder)
+        aec_encode_end(&cache->encoder);
+    if (cache->have_decoder)
+        aec_decode_end(&cache->decoder);
+    free(cache);
+}
+
+#if HAVE_PTHREAD
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static int cache_key_ok;
+
+static void create_cache_key(void)
+{
+    /* Caches are freed when their thread exits */
+    cache_key_ok = pthread_key_create(&cache_key, free_cache) == 0;
+}
+
+static struct sz_cache *get_cache(int create)
+{
+    struct sz_cache *cache;
+
+    if (pthread_once(&cache_once, create_cache_key) != 0 || !cache_key_ok)
+        return NULL;
+
+    cache = pthread_getspecific(cache_key);
+    if (cache == NULL && create) {
+        cache = calloc(1, sizeof(struct sz_cache));
+        if (cache && pthread_setspecific(cache_key, cache) != 0) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+    return cache;
+}
+
+static void drop_cache(void)
+{
+    struct sz_cache *cache = get_cache(0);
+
+    if (cache) {
+        pthread_setspecific(cache_key, NULL);
+        free_cache(cache);
+    }
+}
+
+#if defined(__GNUC__)
+__attribute__((destructor))
+static void delete_cache_key(void)
+{
+    /* free_cache() must not be called by exiting threads once the
+     * library is unloaded with dlclose(). Deleting the key prevents
+     * that. Caches of other threads which are still alive are
+     * leaked. */
+    if (cache_key_ok) {
+        drop_cache();
+        pthread_key_delete(cache_key);
+        cache_key_ok = 0;
+    }
+}
+#endif
+#else
+/* No thread local storage without POSIX threads: nothing is
+ * cached. */
+static struct sz_cache *get_cache(int create)
+{
+    (void)create;
+    return NULL;
+}
+
+static void drop_cache(void)
+{
+}
+#endif
+
+static int take_cached(struct aec_stream *strm, struct aec_stream *cached)
+{
+    /* Move the cached state to strm if it was set up with the same
+     * parameters. */
+    if (cached->bits_per_sample != strm->bits_per_sample
+        || cached->block_size != strm->block_size
+        || cached->rsi != strm->rsi
+        || cached->flags != strm->flags)
+        return 0;
+
+    strm->state = cached->state;
+    strm->total_in = 0;
+    strm->total_out = 0;
+    return 1;
+}
+
+static int encode_init(struct aec_stream *strm)
+{
+    struct sz_cache *cache = get_cache(1);
+
+    if (cache && cache->have_encoder) {
+        cache->have_encoder = 0;
+        if (take_cached(strm, &cache->encoder))
+            return AEC_OK;
+        aec_encode_end(&cache->encoder);
+    }
+    return aec_encode_init(strm);
+}
+
+static int encode_end(struct aec_stream *strm)
+{
+    /* Reset the state and keep it for the next call. The caller
+     * still needs the output length. */
+    struct sz_cache *cache = get_cache(0);
+    size_t total_out;
+    int status;
+
+    if (cache == NULL)
+        return aec_encode_end(strm);
+
+    total_out = strm->total_out;
+    status = aec_encode_reset(strm);
+    if (status != AEC_OK) {
+        /* Not flushed, or the state could not be set up again. It
+         * is not cached either way. Only the former concerns the
+         * coded data. */
+        aec_encode_end(strm);
+        strm->total_out = total_out;
+        return status == AEC_STREAM_ERROR ? status : AEC_OK;
+    }
+    cache->encoder = *strm;
+    cache->have_encoder = 1;
+    strm->total_out = total_out;
+    return status;
+}
+
+static int decode_init(struct aec_stream *strm)
+{
+    struct sz_cache *cache = get_cache(1);
+
+    if (cache && cache->have_decoder) {
+        cache->have_decoder = 0;
+        if (take_cached(strm, &cache->decoder))
+            return AEC_OK;
+        aec_decode_end(&cache->decoder);
+    }
+    return aec_decode_init(strm);
+}
+
+static int decode_end(struct aec_stream *strm)
+{
+    struct sz_cache *cache = get_cache(0);
+    size_t total_out;
+    int status;
+
+    if (cache == NULL)
+        return aec_decode_end(strm);
+
+    total_out = strm->total_out;
+    status = aec_decode_reset(strm);
+    if (status != AEC_OK) {
+        /* The state could not be set up again and is not cached.
+         * The decoded data is not affected. */
+        aec_decode_end(strm);
+        strm->total_out = total_out;
+        return AEC_OK;
+    }
+    cache->decoder = *strm;
+    cache->have_decoder = 1;
+    strm->total_out = total_out;
+    return status;
+}
 
 static int convert_options(int sz_opts)
 {
@@ -60,73 +245,52 @@ static int convert_options(int sz_opts)
     return opts;
 }
 
-static int bits_to_bytes(int bit_length)
+static int sz_threads(int sz_opts)
 {
-    if (bit_length > 16)
-        return 4;
-    else if (bit_length > 8)
-        return 2;
-    else
-        return 1;
-}
+    /* Number of threads from SZ_THREADS, 0 stands for one per
+     * processor. */
+    const char *env = getenv("SZ_THREADS");
 
-static void interleave_buffer(void *dest, const void *src,
-                              size_t n, int wordsize)
-{
-    const unsigned char *src8 = (unsigned char *)src;
-    unsigned char *dest8 = (unsigned char *)dest;
-
-    for (size_t i = 0; i < n / wordsize; i++)
-        for (size_t j = 0; j < wordsize; j++)
-            dest8[j * (n / wordsize) + i] = src8[i * wordsize + j];
+    if (env && *env) {
+        int n = atoi(env);
+        return n < 0 ? 1 : n;
+    }
+    return (sz_opts & SZ_THREADS_OPTION_MASK) ? 0 : 1;
 }
 
-static void deinterleave_buffer(void *dest, const void *src,
-                                size_t n, int wordsize)
+static size_t set_parameters(struct aec_stream *strm,
+                             const SZ_com_t *param)
 {
-    const unsigned char *src8 = (unsigned char *)src;
-    unsigned char *dest8 = (unsigned char *)dest;
+    /* Coder parameters for SZ parameters. 32 and 64 bit pixels are
+     * coded as byte planes, their word size is returned. */
+    size_t wordsize = 0;
 
-    for (size_t i = 0; i < n / wordsize; i++)
-        for (size_t j = 0; j < wordsize; j++)
-            dest8[i * wordsize + j] = src8[j * (n / wordsize) + i];
-}
+    strm->block_size = param->pixels_per_block;
+    strm->rsi = (param->pixels_per_scanline + param->pixels_per_block - 1)
+        / param->pixels_per_block;
+    strm->flags = convert_options(param->options_mask);
 
-static void add_padding(void *dest, const void *src, size_t src_length,
-                        size_t line_size, size_t padding_size,
-                        int pixel_size, int pp)
-{
-    const char zero_pixel[] = {0, 0, 0, 0};
-
-    const char *pixel = zero_pixel;
-    size_t j = 0;
-    size_t i = 0;
-    while (i < src_length) {
-        size_t ps;
-        size_t ls = MIN(src_length - i, line_size);
-        memcpy((char *)dest + j, (char *)src + i, ls);
-        j += ls;
-        i += ls;
-        if (pp)
-            pixel = (char *)src + i - pixel_size;
-        ps = line_size + padding_size - ls;
-        for (size_t k = 0; k < ps; k += pixel_size)
-            memcpy((char *)dest + j + k, pixel, pixel_size);
-        j += ps;
+    if (param->bits_per_pixel == 32 || param->bits_per_pixel == 64) {
+        strm->bits_per_sample = 8;
+        wordsize = param->bits_per_pixel / 8;
+    } else {
+        strm->bits_per_sample = param->bits_per_pixel;
     }
+    return wordsize;
 }
 
-static void remove_padding(void *buf, size_t buf_length,
-                           size_t line_size, size_t padding_size,
-                           int pixel_size)
+static int set_encoder_options(struct aec_stream *strm,
+                               const SZ_com_t *param)
 {
-    size_t padded_line_size = line_size + padding_size;
-
-    size_t i = line_size;
-    for (size_t j = padded_line_size; j < buf_length; j += padded_line_size) {
-        memmove((char *)buf + i, (char *)buf + j, line_size);
-        i += line_size;
-    }
+    /* The encoder pads scanlines to full RSIs itself. */
+    int status = aec_encode_set_scanline(
+        strm, param->pixels_per_scanline,
+        strm->flags & AEC_DATA_PREPROCESS ? AEC_PAD_LAST : AEC_PAD_ZERO);
+
+    if (status == AEC_OK)
+        status = aec_encode_set_threads(strm,
+                                        sz_threads(param->options_mask));
+    return status;
 }
 
 int SZ_BufftoBuffCompress(void *dest, size_t *destLen,
@@ -134,159 +298,190 @@ int SZ_BufftoBuffCompress(void *dest, size_t *destLen,
                           SZ_com_t *param)
 {
     struct aec_stream strm;
-    void *buf = 0;
-    void *padbuf = 0;
     int status;
-    int interleave;
-    int pixel_size;
+    size_t wordsize;
     int aec_status;
-    size_t scanlines;
-    size_t padbuf_size;
-    size_t padding_size;
 
-    strm.block_size = param->pixels_per_block;
-    strm.rsi = (param->pixels_per_scanline + param->pixels_per_block - 1)
-        / param->pixels_per_block;
-    strm.flags = AEC_NOT_ENFORCE | convert_options(param->options_mask);
+    wordsize = set_parameters(&strm, param);
+    strm.flags |= AEC_NOT_ENFORCE;
     strm.avail_out = *destLen;
     strm.next_out = dest;
+    strm.next_in = source;
+    strm.avail_in = sourceLen;
 
-    interleave = param->bits_per_pixel == 32 || param->bits_per_pixel == 64;
-    if (interleave) {
-        strm.bits_per_sample = 8;
-        buf = malloc(sourceLen);
-        if (buf == NULL) {
-            status = SZ_MEM_ERROR;
-            goto CLEANUP;
-        }
-        interleave_buffer(buf, source, sourceLen, param->bits_per_pixel / 8);
-    } else {
-        strm.bits_per_sample = param->bits_per_pixel;
-        buf = (void *)source;
-    }
-
-    pixel_size = bits_to_bytes(strm.bits_per_sample);
-
-    scanlines = (sourceLen / pixel_size + param->pixels_per_scanline - 1)
-        / param->pixels_per_scanline;
-    padbuf_size = strm.rsi * strm.block_size * pixel_size * scanlines;
-    padbuf = malloc(padbuf_size);
-    if (padbuf == NULL) {
-        status = SZ_MEM_ERROR;
-        goto CLEANUP;
+    aec_status = encode_init(&strm);
+    if (aec_status == AEC_OK) {
+        if (wordsize)
+            aec_status = aec_encode_set_planes(&strm, wordsize,
+                                               sourceLen / wordsize);
+        if (aec_status == AEC_OK)
+            aec_status = set_encoder_options(&strm, param);
+        if (aec_status == AEC_OK)
+            aec_status = aec_encode(&strm, AEC_FLUSH);
+        if (aec_status == AEC_OK)
+            aec_status = encode_end(&strm);
+        else
+            encode_end(&strm);
     }
 
-    padding_size =
-        (strm.rsi * strm.block_size - param->pixels_per_scanline)
-        * pixel_size;
-
-    add_padding(padbuf, buf, sourceLen,
-                param->pixels_per_scanline * pixel_size,
-                padding_size, pixel_size,
-                strm.flags & AEC_DATA_PREPROCESS);
-    strm.next_in = padbuf;
-    strm.avail_in = padbuf_size;
-
-    aec_status = aec_buffer_encode(&strm);
     if (aec_status == AEC_STREAM_ERROR)
         status = SZ_OUTBUFF_FULL;
     else
         status = aec_status;
     *destLen = strm.total_out;
+    return status;
+}
 
-CLEANUP:
-    if (padbuf)
-        free(padbuf);
-    if (interleave && buf)
-        free(buf);
+static int decompress(struct aec_stream *strm, void *dest, size_t destLen,
+                      size_t wordsize, size_t pixels_per_scanline,
+                      int threads)
+{
+    /* Decode into dest. The decoder drops the scanline padding and
+     * writes byte planes straight into their place in the words if
+     * wordsize is set. */
+    int status;
+
+    strm->next_out = dest;
+    strm->avail_out = destLen;
+
+    status = decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    if (wordsize)
+        status = aec_decode_set_planes(strm, wordsize, destLen / wordsize);
+    if (status == AEC_OK)
+        status = aec_decode_set_scanline(strm, pixels_per_scanline);
+    if (status == AEC_OK)
+        status = aec_decode_set_threads(strm, threads);
+    if (status == AEC_OK)
+        status = aec_decode(strm, AEC_FLUSH);
+    decode_end(strm);
     return status;
 }
 
+static int regroup_planes(void *dest, size_t destLen, size_t n,
+                          size_t wordsize)
+{
+    /* The planes are shorter than assumed. The stream doesn't record
+     * its length, so this is only known once it has been decoded.
+     * Byte k of the stream was written to word k % plane_len, byte
+     * k / plane_len with the plane length of destLen. Collect the n
+     * decoded bytes in stream order and put them into their words
+     * once instead of decoding again. */
+    unsigned char *dest8 = dest;
+    unsigned char *buf;
+    size_t plane_len = destLen / wordsize;
+    size_t k = 0;
+
+    buf = malloc(n);
+    if (buf == NULL)
+        return SZ_MEM_ERROR;
+
+    for (size_t j = 0; k < n; j++)
+        for (size_t i = 0; i < plane_len && k < n; i++)
+            buf[k++] = dest8[i * wordsize + j];
+
+    for (size_t i = 0; i < n / wordsize; i++)
+        for (size_t j = 0; j < wordsize; j++)
+            dest8[i * wordsize + j] = buf[j * (n / wordsize) + i];
+
+    free(buf);
+    return AEC_OK;
+}
+
 int SZ_BufftoBuffDecompress(void *dest, size_t *destLen,
                             const void *source, size_t sourceLen,
                             SZ_com_t *param)
 {
     struct aec_stream strm;
-    void *buf = 0;
     int status;
-    int pad_scanline;
-    int deinterleave;
-    int extra_buffer;
-    int pixel_size;
-    size_t total_out;
-    size_t scanlines;
+    size_t wordsize;
+    int threads = sz_threads(param->options_mask);
 
-    strm.block_size = param->pixels_per_block;
-    strm.rsi = (param->pixels_per_scanline + param->pixels_per_block - 1)
-        / param->pixels_per_block;
-    strm.flags = convert_options(param->options_mask);
+    wordsize = set_parameters(&strm, param);
     strm.avail_in = sourceLen;
     strm.next_in = source;
 
-    pad_scanline = param->pixels_per_scanline % param->pixels_per_block;
-    deinterleave = (param->bits_per_pixel == 32
-                        || param->bits_per_pixel == 64);
-    extra_buffer = pad_scanline || deinterleave;
+    status = decompress(&strm, dest, *destLen, wordsize,
+                        param->pixels_per_scanline, threads);
 
-    if (deinterleave)
-        strm.bits_per_sample = 8;
-    else
-        strm.bits_per_sample = param->bits_per_pixel;
-    pixel_size = bits_to_bytes(strm.bits_per_sample);
-
-
-    if (extra_buffer) {
-        size_t buf_size;
-        if (pad_scanline) {
-            scanlines = (*destLen / pixel_size + param->pixels_per_scanline - 1)
-                / param->pixels_per_scanline;
-            buf_size = strm.rsi * strm.block_size * pixel_size * scanlines;
-        } else {
-            buf_size = *destLen;
-        }
-        buf = malloc(buf_size);
-        if (buf == NULL) {
-            status = SZ_MEM_ERROR;
-            goto CLEANUP;
-        }
-        strm.next_out = buf;
-        strm.avail_out = buf_size;
-    } else {
-        strm.next_out = dest;
-        strm.avail_out = *destLen;
-    }
+    if (status == AEC_OK && wordsize
+        && strm.total_out / wordsize < *destLen / wordsize)
+        status = regroup_planes(dest, *destLen, strm.total_out, wordsize);
+    if (status != AEC_OK)
+        return status;
+
+    if (strm.total_out < *destLen)
+        *destLen = strm.total_out;
+    return status;
+}
+
+int SZ_StreamCompressInit(struct aec_stream *strm, SZ_com_t *param)
+{
+    int status;
 
-    status = aec_buffer_decode(&strm);
+    /* Byte planes span the whole buffer */
+    if (set_parameters(strm, param))
+        return SZ_PARAM_ERROR;
+    strm->flags |= AEC_NOT_ENFORCE;
+
+    status = aec_encode_init(strm);
     if (status != AEC_OK)
-        goto CLEANUP;
-
-    if (pad_scanline) {
-        size_t padding_size =
-            (strm.rsi * strm.block_size - param->pixels_per_scanline)
-            * pixel_size;
-        remove_padding(buf, strm.total_out,
-                       param->pixels_per_scanline * pixel_size,
-                       padding_size, pixel_size);
-        total_out = scanlines * param->pixels_per_scanline * pixel_size;
-    } else {
-        total_out = strm.total_out;
-    }
+        return status;
+    status = set_encoder_options(strm, param);
+    if (status != AEC_OK)
+        aec_encode_end(strm);
+    return status;
+}
 
-    if (total_out < *destLen)
-        *destLen = total_out;
+int SZ_StreamCompress(struct aec_stream *strm, int finish)
+{
+    return aec_encode(strm, finish ? AEC_FLUSH : AEC_NO_FLUSH);
+}
 
-    if (deinterleave)
-        deinterleave_buffer(dest, buf, *destLen, param->bits_per_pixel / 8);
-    else if (pad_scanline)
-        memcpy(dest, buf, *destLen);
+int SZ_StreamCompressEnd(struct aec_stream *strm)
+{
+    int status = aec_encode_end(strm);
 
-CLEANUP:
-    if (extra_buffer && buf)
-        free(buf);
+    if (status == AEC_STREAM_ERROR)
+        return SZ_OUTBUFF_FULL;
+    return status;
+}
+
+int SZ_StreamDecompressInit(struct aec_stream *strm, SZ_com_t *param)
+{
+    int status;
 
+    if (set_parameters(strm, param))
+        return SZ_PARAM_ERROR;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    status = aec_decode_set_scanline(strm, param->pixels_per_scanline);
+    if (status == AEC_OK)
+        status = aec_decode_set_threads(strm,
+                                        sz_threads(param->options_mask));
+    if (status != AEC_OK)
+        aec_decode_end(strm);
     return status;
 }
 
+int SZ_StreamDecompress(struct aec_stream *strm)
+{
+    return aec_decode(strm, AEC_NO_FLUSH);
+}
+
+int SZ_StreamDecompressEnd(struct aec_stream *strm)
+{
+    return aec_decode_end(strm);
+}
+
+void SZ_release_cache(void)
+{
+    drop_cache();
+}
+
 int SZ_encoder_enabled(void)
 {
     return 1;
@@ -0,0 +1,101 @@
+/**
+ * @file threads.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Run independent tasks on worker threads
+ *
+ */
+
+#include "config.h"
+#include "threads.h"
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct task_arg {
+    void (*task)(void *);
+    void *arg;
+};
+
+int aec_cpu_count(void)
+{
+#if HAVE_PTHREAD && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 1)
+        return n > AEC_MAX_THREADS ? AEC_MAX_THREADS : (int)n;
+#endif
+    return 1;
+}
+
+#if HAVE_PTHREAD
+static void *run_task(void *arg)
+{
+    struct task_arg *t = arg;
+    t->task(t->arg);
+    return NULL;
+}
+
+void aec_run_tasks(void (*task)(void *), void *args, size_t size, int n)
+{
+    /**
+       The calling thread runs the first task. Tasks which don't get
+       a thread of their own run on the calling thread, too.
+    */
+
+    pthread_t threads[AEC_MAX_THREADS];
+    struct task_arg targs[AEC_MAX_THREADS];
+    int started[AEC_MAX_THREADS];
+
+    for (int i = 1; i < n; i++) {
+        targs[i].task = task;
+        targs[i].arg = (char *)args + i * size;
+        started[i] = pthread_create(&threads[i], NULL,
+                                    run_task, &targs[i]) == 0;
+    }
+    if (n > 0)
+        task(args);
+    for (int i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            task((char *)args + i * size);
+    }
+}
+#else
+void aec_run_tasks(void (*task)(void *), void *args, size_t size, int n)
+{
+    for (int i = 0; i < n; i++)
+        task((char *)args + i * size);
+}
+#endif
@@ -0,0 +1,421 @@
+/**
+ * @file uring.c
+ *
+ * @section LICENSE
+ * Copyright 2021 Mathis Rosenhauer, Moritz Hanke, Joerg Behrens, Luis Kornblueh
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Bulk file coding with io_uring and direct I/O for the aec client
+ *
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include "uring.h"
+
+#if HAVE_LINUX_IO_URING_H
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Alignment of buffers, lengths and offsets for O_DIRECT */
+#define ALIGN 4096
+
+/* Buffers in flight for reading and for writing */
+#define NBUF 4
+
+#define READ_OP 0
+#define WRITE_OP 1
+
+struct ring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    /* submission queue entries not yet passed to the kernel */
+    unsigned pending;
+};
+
+struct buffer {
+    unsigned char *data;
+    size_t len;
+    /* read or write in flight */
+    int busy;
+};
+
+struct uring {
+    struct ring ring;
+    struct buffer in[NBUF];
+    struct buffer out[NBUF];
+    int in_fd;
+    int out_fd;
+    size_t chunk;
+    off_t in_size;
+    /* offset of the next read and write */
+    off_t in_off;
+    off_t out_off;
+    /* first failed request */
+    int error;
+};
+
+static int ring_init(struct ring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    long fd;
+
+    memset(&p, 0, sizeof(p));
+    fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return -1;
+    r->fd = (int)fd;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto fail_sq;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto fail_cq;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail_sqes;
+
+    r->sq_head = (unsigned *)((char *)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    r->pending = 0;
+    return 0;
+
+fail_sqes:
+    if (r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+fail_cq:
+    munmap(r->sq_ptr, r->sq_len);
+fail_sq:
+    close(r->fd);
+    return -1;
+}
+
+static void ring_exit(struct ring *r)
+{
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+static void ring_prep(struct ring *r, int op, int fd, struct buffer *b,
+                      off_t off, uint64_t user_data)
+{
+    /* The ring has room for all buffers, so there always is a free
+     * entry. */
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op == READ_OP ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)b->data;
+    sqe->len = (uint32_t)b->len;
+    sqe->off = (uint64_t)off;
+    sqe->user_data = user_data;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->pending++;
+    b->busy = 1;
+}
+
+static int ring_enter(struct ring *r, unsigned wait)
+{
+    /* Submit pending entries and wait for wait completions */
+    long ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, r->pending, wait,
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return -1;
+    r->pending -= (unsigned)ret;
+    return 0;
+}
+
+static int reap(struct uring *u, int wait)
+{
+    /* Process one completion, waiting for it if wait is set.
+     * Returns 0 if there was none. */
+    struct ring *r = &u->ring;
+    unsigned head = *r->cq_head;
+    struct io_uring_cqe *cqe;
+    struct buffer *b;
+    int index;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        if (!wait)
+            return 0;
+        if (ring_enter(r, 1))
+            return u->error = -errno;
+        head = *r->cq_head;
+        if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+            return 0;
+    }
+
+    cqe = &r->cqes[head & *r->cq_mask];
+    index = (int)(cqe->user_data >> 1);
+    b = cqe->user_data & 1 ? &u->out[index] : &u->in[index];
+    if (cqe->res < 0 || (size_t)cqe->res != b->len) {
+        if (u->error == 0)
+            u->error = cqe->res < 0 ? cqe->res : -EIO;
+    }
+    b->busy = 0;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void submit_read(struct uring *u, int i)
+{
+    struct buffer *b = &u->in[i];
+    off_t left = u->in_size - u->in_off;
+
+    /* A read ending at EOF returns what is left. The length is
+     * still aligned, as O_DIRECT requires. */
+    b->len = left < (off_t)u->chunk ? (size_t)left : u->chunk;
+    if (b->len % ALIGN) {
+        size_t len = b->len;
+        b->len += ALIGN - len % ALIGN;
+        ring_prep(&u->ring, READ_OP, u->in_fd, b, u->in_off,
+                  (uint64_t)i << 1);
+        b->len = len;
+    } else {
+        ring_prep(&u->ring, READ_OP, u->in_fd, b, u->in_off,
+                  (uint64_t)i << 1);
+    }
+    u->in_off += (off_t)b->len;
+}
+
+static void submit_write(struct uring *u, int i, size_t len)
+{
+    struct buffer *b = &u->out[i];
+
+    /* The last write is padded to the alignment, the file is
+     * truncated afterwards. */
+    b->len = (len + ALIGN - 1) / ALIGN * ALIGN;
+    memset(b->data + len, 0, b->len - len);
+    ring_prep(&u->ring, WRITE_OP, u->out_fd, b, u->out_off,
+              (uint64_t)i << 1 | 1);
+    u->out_off += (off_t)len;
+}
+
+static int wait_idle(struct uring *u, struct buffer *b)
+{
+    if (u->ring.pending && ring_enter(&u->ring, 0))
+        return u->error = -errno;
+    while (b->busy && u->error == 0)
+        if (reap(u, 1) < 0)
+            break;
+    return u->error;
+}
+
+static int code(struct uring *u, struct aec_stream *strm, int dflag,
+                int flush, int *out_i, size_t *fill)
+{
+    /* Code until the coder stops filling output buffers. Full
+     * buffers are written while coding goes on. */
+    int status;
+
+    do {
+        struct buffer *b = &u->out[*out_i];
+
+        if (*fill == 0 && wait_idle(u, b))
+            return 99;
+        strm->next_out = b->data + *fill;
+        strm->avail_out = u->chunk - *fill;
+        if (dflag)
+            status = aec_decode(strm, flush);
+        else
+            status = aec_encode(strm, flush);
+        if (status != AEC_OK)
+            return status;
+        *fill = u->chunk - strm->avail_out;
+        if (*fill == u->chunk) {
+            submit_write(u, *out_i, u->chunk);
+            *out_i = (*out_i + 1) % NBUF;
+            *fill = 0;
+        }
+    } while (strm->avail_out == 0);
+    return AEC_OK;
+}
+
+int uring_code(struct aec_stream *strm, int dflag,
+               const char *infn, const char *outfn,
+               size_t chunk, size_t unit)
+{
+    struct uring u;
+    struct stat st;
+    int status = URING_UNAVAILABLE;
+    int in_i = 0;
+    int out_i = 0;
+    size_t fill = 0;
+    int started = 0;
+
+    memset(&u, 0, sizeof(u));
+    u.in_fd = -1;
+    u.out_fd = -1;
+
+    /* Buffers hold whole samples and are aligned for O_DIRECT */
+    u.chunk = (chunk + ALIGN * unit - 1) / (ALIGN * unit) * (ALIGN * unit);
+
+    u.in_fd = open(infn, O_RDONLY | O_DIRECT);
+    if (u.in_fd < 0 || fstat(u.in_fd, &st) != 0 || !S_ISREG(st.st_mode))
+        goto exit_files;
+    u.in_size = st.st_size;
+    u.out_fd = open(outfn, O_WRONLY | O_TRUNC | O_DIRECT);
+    if (u.out_fd < 0 || fstat(u.out_fd, &st) != 0 || !S_ISREG(st.st_mode))
+        goto exit_files;
+
+    for (int i = 0; i < NBUF; i++) {
+        if (posix_memalign((void **)&u.in[i].data, ALIGN, u.chunk)
+            || posix_memalign((void **)&u.out[i].data, ALIGN, u.chunk))
+            goto exit_buffers;
+    }
+    if (ring_init(&u.ring, 2 * NBUF))
+        goto exit_buffers;
+
+    for (int i = 0; i < NBUF && u.in_off < u.in_size; i++)
+        submit_read(&u, i);
+
+    strm->avail_in = 0;
+    status = AEC_OK;
+    while (u.in[in_i].len > 0) {
+        struct buffer *b = &u.in[in_i];
+
+        if (wait_idle(&u, b)) {
+            /* Direct I/O is refused before anything was coded */
+            status = started ? 99 : URING_UNAVAILABLE;
+            break;
+        }
+        started = 1;
+        strm->next_in = b->data;
+        strm->avail_in = b->len;
+        status = code(&u, strm, dflag, AEC_NO_FLUSH, &out_i, &fill);
+        if (status != AEC_OK)
+            break;
+        b->len = 0;
+        if (u.in_off < u.in_size)
+            submit_read(&u, in_i);
+        in_i = (in_i + 1) % NBUF;
+    }
+
+    if (status == AEC_OK && !dflag)
+        status = code(&u, strm, dflag, AEC_FLUSH, &out_i, &fill);
+    if (status == AEC_OK && fill > 0)
+        submit_write(&u, out_i, fill);
+
+    /* Wait for everything in flight before buffers are freed */
+    if (u.ring.pending)
+        ring_enter(&u.ring, 0);
+    for (int i = 0; i < NBUF; i++) {
+        while ((u.in[i].busy || u.out[i].busy) && reap(&u, 1) >= 0)
+            ;
+    }
+    if (status == AEC_OK && u.error)
+        status = 99;
+    if (status == AEC_OK && ftruncate(u.out_fd, u.out_off) != 0)
+        status = 99;
+
+    ring_exit(&u.ring);
+exit_buffers:
+    for (int i = 0; i < NBUF; i++) {
+        free(u.in[i].data);
+        free(u.out[i].data);
+    }
+exit_files:
+    if (u.in_fd >= 0)
+        close(u.in_fd);
+    if (u.out_fd >= 0)
+        close(u.out_fd);
+    return status;
+}
+
+#else
+
+int uring_code(struct aec_stream *strm, int dflag,
+               const char *infn, const char *outfn,
+               size_t chunk, size_t unit)
+{
+    (void)strm;
+    (void)dflag;
+    (void)infn;
+    (void)outfn;
+    (void)chunk;
+    (void)unit;
+    return URING_UNAVAILABLE;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
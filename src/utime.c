@@ -35,73 +35,231 @@
  *
  * Simple timing command, since calling time(1) gives non-portable results.
  *
+ * Runs a command and reports on stderr its wall clock, user and system
+ * time, peak resident set size and, where perf_event_open(2) is
+ * available and permitted, the hardware counters of the command and
+ * its children. One line per quantity: name, value, unit. Counters
+ * which cannot be opened are reported as n/a, counters restricted to
+ * user space get the suffix :u like in perf(1).
+ *
  */
+
+#define _GNU_SOURCE
+#include "config.h"
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#if HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+struct counter
+{
+  const char *name;
+  uint64_t config;
+  int fd;
+  int user_only;
+};
+
+#if HAVE_LINUX_PERF_EVENT_H
+#define COUNTER(name, config) { name, PERF_COUNT_HW_ ## config, -1, 0 }
+#else
+#define COUNTER(name, config) { name, 0, -1, 0 }
+#endif
+
+static struct counter counters[] = {
+  COUNTER("cycles", CPU_CYCLES),
+  COUNTER("instructions", INSTRUCTIONS),
+  COUNTER("branch-misses", BRANCH_MISSES),
+  COUNTER("cache-misses", CACHE_MISSES),
+};
+
+#define NCOUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static void
+open_counters(pid_t pid);
+
+static int
+read_counter(struct counter *c, uint64_t *value);
+
 static int
-run_cmd(int argc, char *argv[]);
+run_cmd(int argc, char *argv[], struct timespec *wall);
+
+static double
+seconds(struct timeval tv)
+{
+  return (tv.tv_sec * 1000000 + tv.tv_usec)/1000000.0;
+}
 
 int main(int argc, char **argv)
 {
-  struct timeval utime = { .tv_sec = 0, .tv_usec = 0 };
-  int rstatus;
-  int status = 0;
-  if (argc > 1 && ((status = run_cmd(argc - 1, argv + 1)) >= 0))
+  struct timespec wall = { .tv_sec = 0, .tv_nsec = 0 };
+  struct rusage usage;
+  uint64_t values[NCOUNTERS];
+  int have[NCOUNTERS];
+  int status;
+
+  if (argc < 2)
   {
-    struct rusage usage;
-    if ((rstatus = getrusage(RUSAGE_CHILDREN, &usage) == -1))
-    {
-      perror("resource usage statistics unavailable");
-    }
-    else if (rstatus != 0)
-    {
-      fputs("an unknown error occurred\n", stderr);
-      return EXIT_FAILURE;
-    }
+    fputs("usage: utime COMMAND [ARG]...\n", stderr);
+    return EXIT_FAILURE;
+  }
+  if ((status = run_cmd(argc - 1, argv + 1, &wall)) < 0)
+  {
+    fputs("could not fork child\n", stderr);
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < NCOUNTERS; i++)
+    have[i] = read_counter(&counters[i], &values[i]);
+
+  if (getrusage(RUSAGE_CHILDREN, &usage) == -1)
+  {
+    perror("resource usage statistics unavailable");
+    memset(&usage, 0, sizeof(usage));
+  }
+#ifdef __APPLE__
+  /* Darwin reports bytes instead of KiB */
+  usage.ru_maxrss /= 1024;
+#endif
+
+  fprintf(stderr, "wall %f s\n", wall.tv_sec + wall.tv_nsec / 1e9);
+  fprintf(stderr, "user %f s\n", seconds(usage.ru_utime));
+  fprintf(stderr, "sys %f s\n", seconds(usage.ru_stime));
+  fprintf(stderr, "maxrss %ld KiB\n", (long)usage.ru_maxrss);
+  for (size_t i = 0; i < NCOUNTERS; i++)
+  {
+    if (have[i])
+      fprintf(stderr, "%s%s %llu\n", counters[i].name,
+              counters[i].user_only ? ":u" : "",
+              (unsigned long long)values[i]);
     else
+      fprintf(stderr, "%s n/a\n", counters[i].name);
+  }
+  if (have[0] && have[1] && values[0] > 0)
+    fprintf(stderr, "insn-per-cycle %.2f\n",
+            (double)values[1] / values[0]);
+
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return EXIT_FAILURE;
+}
+
+static void
+open_counters(pid_t pid)
+{
+#if HAVE_LINUX_PERF_EVENT_H
+  for (size_t i = 0; i < NCOUNTERS; i++)
+  {
+    struct counter *c = &counters[i];
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = c->config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    /* Count from exec on, including threads and child processes */
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+
+    /* Unprivileged users may only be allowed to count user space */
+    for (c->user_only = 0; c->user_only < 2; c->user_only++)
     {
-      utime = usage.ru_utime;
+      attr.exclude_kernel = c->user_only;
+      c->fd = (int)syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+      if (c->fd >= 0)
+        break;
     }
   }
-  else if (status)
+#else
+  (void)pid;
+#endif
+}
+
+static int
+read_counter(struct counter *c, uint64_t *value)
+{
+  uint64_t buf[3];
+  int ok = 0;
+
+  if (c->fd < 0)
+    return 0;
+  if (read(c->fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && buf[2] > 0)
   {
-    fputs("could not fork child\n", stderr);
-    return EXIT_FAILURE;
+    /* Scale if the counter had to share the PMU with others */
+    if (buf[2] < buf[1])
+      buf[0] = (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+    *value = buf[0];
+    ok = 1;
   }
-  fprintf(stderr, "%f\n", (utime.tv_sec * 1000000 + utime.tv_usec)/1000000.0);
-  return status;
+  close(c->fd);
+  c->fd = -1;
+  return ok;
 }
 
 static int
-run_cmd(int argc, char *argv[])
+run_cmd(int argc, char *argv[], struct timespec *wall)
 {
   int status;
+  int go[2];
   pid_t child_pid;
-  if (argc < 1)
+  struct timespec start, end;
+
+  if (argc < 1 || pipe(go) < 0)
     return -1;
   if ((child_pid = fork()) < 0)
+  {
+    close(go[0]);
+    close(go[1]);
     status = -1;
+  }
   else if (child_pid == 0)
   {
-    /* child */
+    /* child: wait until the counters are attached */
+    char c;
+    close(go[1]);
+    while (read(go[0], &c, 1) < 0 && errno == EINTR)
+      ;
+    close(go[0]);
     execvp(argv[0], argv);
+    perror(argv[0]);
     _exit(127); /* execvp should not have returned */
   }
   else
   {
+    close(go[0]);
+    open_counters(child_pid);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    close(go[1]);
     while (waitpid(child_pid, &status, 0) < 0)
       if (errno != EINTR)
       {
         status = -1;
         break;
       }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall->tv_sec = end.tv_sec - start.tv_sec;
+    wall->tv_nsec = end.tv_nsec - start.tv_nsec;
+    if (wall->tv_nsec < 0)
+    {
+      wall->tv_sec--;
+      wall->tv_nsec += 1000000000;
+    }
   }
   return status;
 }
@@ -0,0 +1,446 @@
+/*
+ * Throughput and compression ratio on the CCSDS sample data for a
+ * range of legal block sizes, RSIs and flags. Results are written
+ * as CSV or JSON and can be compared with a baseline CSV from an
+ * earlier run. Any loss in ratio or a loss in throughput beyond a
+ * tolerance counts as a regression.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libaec.h"
+
+#define MAX_RESULTS 4096
+
+struct result {
+    char file[64];
+    unsigned int bits_per_sample;
+    unsigned int block_size;
+    unsigned int rsi;
+    unsigned int flags;
+    double encode_mbs;
+    double decode_mbs;
+    double ratio;
+};
+
+struct corpus_file {
+    char name[64];
+    unsigned int bits_per_sample;
+};
+
+static const unsigned int block_sizes[] = {8, 16, 32, 64};
+static const unsigned int rsis[] = {16, 256, 4096};
+static const unsigned int flag_sets[] = {
+    AEC_DATA_PREPROCESS,
+    0,
+    AEC_DATA_PREPROCESS | AEC_RESTRICTED
+};
+
+#define LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *t, int n)
+{
+    qsort(t, n, sizeof(double), cmp_double);
+    return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+static size_t corpus(struct corpus_file *files)
+{
+    /**
+       Sample files below data/121B2TestData. Sample sizes follow
+       from the names.
+    */
+
+    size_t n = 0;
+
+    for (unsigned int i = 1; i <= 32; i++) {
+        snprintf(files[n].name, sizeof(files[n].name),
+                 "AllOptions/test_p%sn%02u.dat", i <= 16 ? "256" : "512",
+                 i);
+        files[n++].bits_per_sample = i;
+    }
+    for (int i = 1; i <= 3; i++) {
+        snprintf(files[n].name, sizeof(files[n].name),
+                 "LowEntropyOptions/Lowset%i_8bit.dat", i);
+        files[n++].bits_per_sample = 8;
+    }
+    strcpy(files[n].name, "ExtendedParameters/sar32bit.dat");
+    files[n++].bits_per_sample = 32;
+    return n;
+}
+
+static int code(struct aec_stream *param, int decode, size_t iters,
+                const unsigned char *in, size_t in_len,
+                unsigned char *out, size_t out_len, size_t *total_out)
+{
+    /**
+       Code in iters times. The stream is reset in between like a
+       caller would do for many small buffers.
+    */
+
+    struct aec_stream strm = *param;
+    int status;
+
+    status = decode ? aec_decode_init(&strm) : aec_encode_init(&strm);
+    for (size_t i = 0; i < iters && status == AEC_OK; i++) {
+        strm.next_in = in;
+        strm.avail_in = in_len;
+        strm.next_out = out;
+        strm.avail_out = out_len;
+        strm.total_out = 0;
+        if (decode) {
+            status = aec_decode(&strm, AEC_FLUSH);
+            *total_out = strm.total_out;
+            if (status == AEC_OK && i + 1 < iters)
+                status = aec_decode_reset(&strm);
+        } else {
+            status = aec_encode(&strm, AEC_FLUSH);
+            *total_out = strm.total_out;
+            if (status == AEC_OK && i + 1 < iters)
+                status = aec_encode_reset(&strm);
+        }
+    }
+    if (status != AEC_OK)
+        return status;
+    return decode ? aec_decode_end(&strm) : aec_encode_end(&strm);
+}
+
+static int measure(struct aec_stream *param, struct result *r,
+                   const unsigned char *src, size_t len,
+                   unsigned char *rz, size_t rz_max, unsigned char *dec,
+                   double *t, int runs, double min_time)
+{
+    /**
+       Encode and decode src runs times. Small files are coded
+       repeatedly per run, as often as it takes to fill min_time in
+       a first calibration run.
+    */
+
+    size_t rz_len = 0, dec_len = 0;
+
+    for (int decode = 0; decode < 2; decode++) {
+        size_t iters = 1;
+
+        for (int i = -1; i < runs; i++) {
+            double t0 = now();
+            int status = decode
+                ? code(param, 1, iters, rz, rz_len, dec, len, &dec_len)
+                : code(param, 0, iters, src, len, rz, rz_max, &rz_len);
+            if (status != AEC_OK)
+                return status;
+            if (i >= 0) {
+                t[i] = now() - t0;
+            } else if (now() - t0 < min_time) {
+                /* Calibrate again */
+                iters *= 2;
+                i--;
+            }
+        }
+        if (decode)
+            r->decode_mbs = len * iters / median(t, runs) * 1e-6;
+        else
+            r->encode_mbs = len * iters / median(t, runs) * 1e-6;
+    }
+    if (dec_len != len || memcmp(src, dec, len))
+        return -1;
+    r->ratio = (double)len / rz_len;
+    return AEC_OK;
+}
+
+static void write_csv(FILE *fp, const struct result *r, size_t n)
+{
+    fprintf(fp, "file,bits_per_sample,block_size,rsi,flags,"
+            "encode_mbs,decode_mbs,ratio\n");
+    for (size_t i = 0; i < n; i++)
+        fprintf(fp, "%s,%u,%u,%u,%u,%.3f,%.3f,%.6f\n",
+                r[i].file, r[i].bits_per_sample, r[i].block_size,
+                r[i].rsi, r[i].flags, r[i].encode_mbs, r[i].decode_mbs,
+                r[i].ratio);
+}
+
+static void write_json(FILE *fp, const struct result *r, size_t n)
+{
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < n; i++)
+        fprintf(fp, "  {\"file\": \"%s\", \"bits_per_sample\": %u, "
+                "\"block_size\": %u, \"rsi\": %u, \"flags\": %u, "
+                "\"encode_mbs\": %.3f, \"decode_mbs\": %.3f, "
+                "\"ratio\": %.6f}%s\n",
+                r[i].file, r[i].bits_per_sample, r[i].block_size,
+                r[i].rsi, r[i].flags, r[i].encode_mbs, r[i].decode_mbs,
+                r[i].ratio, i + 1 < n ? "," : "");
+    fprintf(fp, "]\n");
+}
+
+static size_t read_csv(FILE *fp, struct result *r, size_t max)
+{
+    char line[256];
+    size_t n = 0;
+
+    while (n < max && fgets(line, sizeof(line), fp)) {
+        char *comma = strchr(line, ',');
+        size_t len;
+
+        if (comma == NULL)
+            continue;
+        len = (size_t)(comma - line);
+        if (len >= sizeof(r[n].file))
+            continue;
+        memcpy(r[n].file, line, len);
+        r[n].file[len] = 0;
+        if (sscanf(comma + 1, "%u,%u,%u,%u,%lf,%lf,%lf",
+                   &r[n].bits_per_sample, &r[n].block_size, &r[n].rsi,
+                   &r[n].flags, &r[n].encode_mbs, &r[n].decode_mbs,
+                   &r[n].ratio) == 7)
+            n++;
+    }
+    return n;
+}
+
+static int same_config(const struct result *a, const struct result *b)
+{
+    return strcmp(a->file, b->file) == 0
+        && a->bits_per_sample == b->bits_per_sample
+        && a->block_size == b->block_size
+        && a->rsi == b->rsi
+        && a->flags == b->flags;
+}
+
+static int compare(const struct result *r, size_t n,
+                   const struct result *base, size_t nbase, double tol)
+{
+    /**
+       Report results which are worse than their baseline. Returns
+       the number of regressions.
+    */
+
+    int regressions = 0;
+    size_t matched = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const struct result *b = NULL;
+
+        for (size_t j = 0; j < nbase && b == NULL; j++)
+            if (same_config(&r[i], &base[j]))
+                b = &base[j];
+        if (b == NULL)
+            continue;
+        matched++;
+
+        if (r[i].ratio < b->ratio * (1 - 1e-6)) {
+            fprintf(stderr, "%s -n%u -j%u -r%u flags %u: "
+                    "ratio %.6f < %.6f\n", r[i].file,
+                    r[i].bits_per_sample, r[i].block_size, r[i].rsi,
+                    r[i].flags, r[i].ratio, b->ratio);
+            regressions++;
+        }
+        if (r[i].encode_mbs < b->encode_mbs * (1 - tol)
+            || r[i].decode_mbs < b->decode_mbs * (1 - tol)) {
+            fprintf(stderr, "%s -n%u -j%u -r%u flags %u: "
+                    "encode %.1f (%.1f) decode %.1f (%.1f) MB/s\n",
+                    r[i].file, r[i].bits_per_sample, r[i].block_size,
+                    r[i].rsi, r[i].flags, r[i].encode_mbs, b->encode_mbs,
+                    r[i].decode_mbs, b->decode_mbs);
+            regressions++;
+        }
+    }
+    fprintf(stderr, "%zu of %zu results compared with baseline, "
+            "%i regressions\n", matched, n, regressions);
+    return regressions;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [OPTION]... DATADIR\n", name);
+    fprintf(stderr, "\nDATADIR is the 121B2TestData directory.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -f FORMAT  csv (default) or json\n");
+    fprintf(stderr, "  -o FILE    write results to FILE instead of stdout\n");
+    fprintf(stderr, "  -b FILE    compare with baseline CSV FILE. If FILE\n");
+    fprintf(stderr, "             does not exist, the results are written\n");
+    fprintf(stderr, "             to it\n");
+    fprintf(stderr, "  -t TOL     tolerated loss of throughput (default 0.2)\n");
+    fprintf(stderr, "  -R N       runs per measurement (default 5)\n");
+    fprintf(stderr, "  -T SECONDS minimum duration of a run "
+            "(default 0.01)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct corpus_file files[64];
+    struct result *results = NULL, *base = NULL;
+    unsigned char *src = NULL, *rz = NULL, *dec = NULL;
+    double *t = NULL;
+    const char *format = "csv";
+    const char *outfn = NULL, *basefn = NULL;
+    double tol = 0.2;
+    double min_time = 0.01;
+    size_t nfiles, n = 0, nbase = 0;
+    int runs = 5;
+    int status = 1;
+    int opt;
+    FILE *fp;
+
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        char o = argv[opt][1];
+        if (o && strchr("fobtRT", o) && opt + 1 < argc) {
+            const char *v = argv[++opt];
+            if (o == 'f')
+                format = v;
+            else if (o == 'o')
+                outfn = v;
+            else if (o == 'b')
+                basefn = v;
+            else if (o == 't')
+                tol = atof(v);
+            else if (o == 'R')
+                runs = atoi(v);
+            else
+                min_time = atof(v);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt + 1 != argc || runs < 1
+        || (strcmp(format, "csv") && strcmp(format, "json"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    nfiles = corpus(files);
+    results = malloc(MAX_RESULTS * sizeof(struct result));
+    base = malloc(MAX_RESULTS * sizeof(struct result));
+    t = malloc(runs * sizeof(double));
+    if (results == NULL || base == NULL || t == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        goto DESTRUCT;
+    }
+
+    for (size_t f = 0; f < nfiles; f++) {
+        char path[1024];
+        size_t len, rz_max;
+        int n_path;
+
+        n_path = snprintf(path, sizeof(path), "%s/%s", argv[opt],
+                          files[f].name);
+        if (n_path < 0 || (size_t)n_path >= sizeof(path)) {
+            fprintf(stderr, "Path too long: %s/%s\n", argv[opt],
+                    files[f].name);
+            goto DESTRUCT;
+        }
+        if ((fp = fopen(path, "rb")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", path);
+            goto DESTRUCT;
+        }
+        fseek(fp, 0L, SEEK_END);
+        len = (size_t)ftell(fp);
+        fseek(fp, 0L, SEEK_SET);
+        rz_max = len * 2 + 1024;
+        free(src);
+        free(rz);
+        free(dec);
+        src = malloc(len);
+        rz = malloc(rz_max);
+        dec = malloc(len);
+        if (src == NULL || rz == NULL || dec == NULL
+            || fread(src, 1, len, fp) != len) {
+            fclose(fp);
+            fprintf(stderr, "Can't read %s\n", path);
+            goto DESTRUCT;
+        }
+        fclose(fp);
+
+        for (size_t b = 0; b < LENGTH(block_sizes); b++) {
+            for (size_t r = 0; r < LENGTH(rsis); r++) {
+                for (size_t s = 0; s < LENGTH(flag_sets); s++) {
+                    struct aec_stream param;
+                    struct result *res = &results[n];
+
+                    if (flag_sets[s] & AEC_RESTRICTED
+                        && files[f].bits_per_sample > 4)
+                        continue;
+                    param.bits_per_sample = files[f].bits_per_sample;
+                    param.block_size = block_sizes[b];
+                    param.rsi = rsis[r];
+                    param.flags = flag_sets[s];
+
+                    strcpy(res->file, files[f].name);
+                    res->bits_per_sample = param.bits_per_sample;
+                    res->block_size = param.block_size;
+                    res->rsi = param.rsi;
+                    res->flags = param.flags;
+                    if (measure(&param, res, src, len, rz, rz_max, dec,
+                                t, runs, min_time) != AEC_OK) {
+                        fprintf(stderr, "%s -n%u -j%u -r%u flags %u "
+                                "failed\n", res->file,
+                                res->bits_per_sample, res->block_size,
+                                res->rsi, res->flags);
+                        goto DESTRUCT;
+                    }
+                    if (++n == MAX_RESULTS)
+                        goto DONE;
+                }
+            }
+        }
+    }
+
+DONE:
+    if (outfn) {
+        if ((fp = fopen(outfn, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", outfn);
+            goto DESTRUCT;
+        }
+    } else {
+        fp = stdout;
+    }
+    if (strcmp(format, "json") == 0)
+        write_json(fp, results, n);
+    else
+        write_csv(fp, results, n);
+    if (outfn)
+        fclose(fp);
+    status = 0;
+
+    if (basefn) {
+        if ((fp = fopen(basefn, "r")) != NULL) {
+            nbase = read_csv(fp, base, MAX_RESULTS);
+            fclose(fp);
+            if (compare(results, n, base, nbase, tol))
+                status = 1;
+        } else if ((fp = fopen(basefn, "w")) != NULL) {
+            fprintf(stderr, "No baseline, writing %s\n", basefn);
+            write_csv(fp, results, n);
+            fclose(fp);
+        } else {
+            fprintf(stderr, "Can't write %s\n", basefn);
+            status = 1;
+        }
+    }
+
+DESTRUCT:
+    free(results);
+    free(base);
+    free(src);
+    free(rz);
+    free(dec);
+    free(t);
+    return status;
+}
@@ -0,0 +1,495 @@
+/*
+ * Throughput of streaming with input and output handed to the coder
+ * in chunks of 1 byte up to the whole buffer. Small chunks exercise
+ * the resumable states of encoder and decoder which whole buffers
+ * avoid. Every stream is checked against the output of a single call.
+ * Results are written as CSV, JSON or a table of throughput per
+ * chunk size and can be compared with a baseline CSV from an earlier
+ * run like those of bench_corpus.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libaec.h"
+
+#define MAX_CHUNKS 32
+#define MAX_RESULTS (MAX_CHUNKS * MAX_CHUNKS)
+
+struct result {
+    size_t in_chunk;
+    size_t out_chunk;
+    double encode_mbs;
+    double decode_mbs;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *t, int n)
+{
+    qsort(t, n, sizeof(double), cmp_double);
+    return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+static size_t chunk_sizes(size_t *chunks, size_t len)
+{
+    /**
+       Powers of four from 1 up to len, and len itself.
+    */
+
+    size_t n = 0;
+
+    for (size_t c = 1; c < len && n < MAX_CHUNKS - 1; c *= 4)
+        chunks[n++] = c;
+    chunks[n++] = len;
+    return n;
+}
+
+static size_t sample_size(const struct aec_stream *strm)
+{
+    if (strm->bits_per_sample > 16)
+        return strm->bits_per_sample <= 24
+            && strm->flags & AEC_DATA_3BYTE ? 3 : 4;
+    return strm->bits_per_sample > 8 ? 2 : 1;
+}
+
+static int stream(struct aec_stream *strm, int decode,
+                  const unsigned char *in, size_t in_len,
+                  unsigned char *out, size_t out_len,
+                  size_t in_chunk, size_t out_chunk)
+{
+    /**
+       Code in to out like a caller which hands over the next
+       in_chunk bytes of input once the coder has taken all it got,
+       and the next out_chunk bytes of output once the coder has
+       filled what it got. If a call neither takes input nor
+       produces output, for instance because less than a sample is
+       left, both are extended by another chunk.
+
+       The decoder needs room for whole samples, so its output
+       chunks are rounded up to whole samples. The encoder is flushed
+       as soon as it has all input. Coding is done when out_len bytes
+       are written.
+    */
+
+    size_t size = sample_size(strm);
+    int stalled = 0;
+    int status;
+
+    if (decode)
+        out_chunk = (out_chunk + size - 1) / size * size;
+
+    strm->next_in = in;
+    strm->avail_in = 0;
+    strm->next_out = out;
+    strm->avail_out = 0;
+    strm->total_in = 0;
+    strm->total_out = 0;
+
+    while (strm->total_out < out_len) {
+        size_t rest_in = in_len - strm->total_in - strm->avail_in;
+        size_t rest_out = out_len - strm->total_out - strm->avail_out;
+        size_t total_in = strm->total_in;
+        size_t total_out = strm->total_out;
+        int flush;
+
+        if (stalled && rest_in == 0 && rest_out == 0)
+            return AEC_STREAM_ERROR;
+        if (strm->avail_in == 0 || stalled)
+            strm->avail_in += in_chunk < rest_in ? in_chunk : rest_in;
+        if (strm->avail_out == 0 || stalled)
+            strm->avail_out += out_chunk < rest_out ? out_chunk : rest_out;
+
+        flush = strm->total_in + strm->avail_in == in_len
+            ? AEC_FLUSH : AEC_NO_FLUSH;
+        status = decode ? aec_decode(strm, flush) : aec_encode(strm, flush);
+        if (status != AEC_OK)
+            return status;
+        stalled = strm->total_in == total_in && strm->total_out == total_out;
+    }
+    return AEC_OK;
+}
+
+static int code(struct aec_stream *param, int decode, size_t iters,
+                const unsigned char *in, size_t in_len,
+                unsigned char *out, size_t out_len,
+                size_t in_chunk, size_t out_chunk)
+{
+    /**
+       Stream in iters times, resetting the stream in between.
+    */
+
+    struct aec_stream strm = *param;
+    int status;
+
+    status = decode ? aec_decode_init(&strm) : aec_encode_init(&strm);
+    for (size_t i = 0; i < iters && status == AEC_OK; i++) {
+        status = stream(&strm, decode, in, in_len, out, out_len,
+                        in_chunk, out_chunk);
+        if (status == AEC_OK && i + 1 < iters)
+            status = decode ? aec_decode_reset(&strm)
+                : aec_encode_reset(&strm);
+    }
+    if (status != AEC_OK) {
+        if (decode)
+            aec_decode_end(&strm);
+        else
+            aec_encode_end(&strm);
+        return status;
+    }
+    return decode ? aec_decode_end(&strm) : aec_encode_end(&strm);
+}
+
+static int measure(struct aec_stream *param, struct result *r,
+                   const unsigned char *src, size_t len,
+                   const unsigned char *ref, size_t ref_len,
+                   unsigned char *rz, unsigned char *dec,
+                   double *t, int runs, double min_time)
+{
+    /**
+       Encode src and decode ref in chunks runs times after a
+       calibration run like bench_corpus does. The results must equal
+       ref and src.
+    */
+
+    for (int decode = 0; decode < 2; decode++) {
+        size_t iters = 1;
+
+        memset(decode ? dec : rz, 0, decode ? len : ref_len);
+        for (int i = -1; i < runs; i++) {
+            double t0 = now();
+            int status = decode
+                ? code(param, 1, iters, ref, ref_len, dec, len,
+                       r->in_chunk, r->out_chunk)
+                : code(param, 0, iters, src, len, rz, ref_len,
+                       r->in_chunk, r->out_chunk);
+            if (status != AEC_OK)
+                return status;
+            if (i >= 0) {
+                t[i] = now() - t0;
+            } else if (now() - t0 < min_time) {
+                /* Calibrate again */
+                iters *= 2;
+                i--;
+            }
+        }
+        if (decode)
+            r->decode_mbs = len * iters / median(t, runs) * 1e-6;
+        else
+            r->encode_mbs = len * iters / median(t, runs) * 1e-6;
+    }
+    if (memcmp(ref, rz, ref_len) || memcmp(src, dec, len))
+        return -1;
+    return AEC_OK;
+}
+
+static void write_csv(FILE *fp, const struct result *r, size_t n)
+{
+    fprintf(fp, "in_chunk,out_chunk,encode_mbs,decode_mbs\n");
+    for (size_t i = 0; i < n; i++)
+        fprintf(fp, "%zu,%zu,%.3f,%.3f\n", r[i].in_chunk,
+                r[i].out_chunk, r[i].encode_mbs, r[i].decode_mbs);
+}
+
+static void write_json(FILE *fp, const struct result *r, size_t n)
+{
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < n; i++)
+        fprintf(fp, "  {\"in_chunk\": %zu, \"out_chunk\": %zu, "
+                "\"encode_mbs\": %.3f, \"decode_mbs\": %.3f}%s\n",
+                r[i].in_chunk, r[i].out_chunk, r[i].encode_mbs,
+                r[i].decode_mbs, i + 1 < n ? "," : "");
+    fprintf(fp, "]\n");
+}
+
+static void write_table(FILE *fp, const struct result *r,
+                        const size_t *chunks, size_t nchunks)
+{
+    /**
+       Throughput in MB/s with a row per input chunk size and a
+       column per output chunk size.
+    */
+
+    for (int decode = 0; decode < 2; decode++) {
+        fprintf(fp, "%s MB/s, input chunk down, output chunk across\n",
+                decode ? "decode" : "encode");
+        fprintf(fp, "%8s", "");
+        for (size_t o = 0; o < nchunks; o++)
+            fprintf(fp, " %8zu", chunks[o]);
+        fprintf(fp, "\n");
+        for (size_t i = 0; i < nchunks; i++) {
+            fprintf(fp, "%8zu", chunks[i]);
+            for (size_t o = 0; o < nchunks; o++) {
+                const struct result *res = &r[i * nchunks + o];
+                fprintf(fp, " %8.1f",
+                        decode ? res->decode_mbs : res->encode_mbs);
+            }
+            fprintf(fp, "\n");
+        }
+        if (decode == 0)
+            fprintf(fp, "\n");
+    }
+}
+
+static size_t read_csv(FILE *fp, struct result *r, size_t max)
+{
+    char line[256];
+    size_t n = 0;
+
+    while (n < max && fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%zu,%zu,%lf,%lf", &r[n].in_chunk,
+                   &r[n].out_chunk, &r[n].encode_mbs,
+                   &r[n].decode_mbs) == 4)
+            n++;
+    }
+    return n;
+}
+
+static int compare(const struct result *r, size_t n,
+                   const struct result *base, size_t nbase, double tol)
+{
+    /**
+       Report results which are slower than their baseline. Returns
+       the number of regressions.
+    */
+
+    int regressions = 0;
+    size_t matched = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const struct result *b = NULL;
+
+        for (size_t j = 0; j < nbase && b == NULL; j++)
+            if (r[i].in_chunk == base[j].in_chunk
+                && r[i].out_chunk == base[j].out_chunk)
+                b = &base[j];
+        if (b == NULL)
+            continue;
+        matched++;
+
+        if (r[i].encode_mbs < b->encode_mbs * (1 - tol)
+            || r[i].decode_mbs < b->decode_mbs * (1 - tol)) {
+            fprintf(stderr, "chunks in %zu out %zu: "
+                    "encode %.1f (%.1f) decode %.1f (%.1f) MB/s\n",
+                    r[i].in_chunk, r[i].out_chunk, r[i].encode_mbs,
+                    b->encode_mbs, r[i].decode_mbs, b->decode_mbs);
+            regressions++;
+        }
+    }
+    fprintf(stderr, "%zu of %zu results compared with baseline, "
+            "%i regressions\n", matched, n, regressions);
+    return regressions;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [OPTION]... FILE\n", name);
+    fprintf(stderr, "\nFILE holds the samples to code.\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  -n BITS    bits per sample (default 16)\n");
+    fprintf(stderr, "  -j SAMPLES block size in samples (default 16)\n");
+    fprintf(stderr, "  -r BLOCKS  reference sample interval in blocks "
+            "(default 128)\n");
+    fprintf(stderr, "  -N         disable pre/post processing\n");
+    fprintf(stderr, "  -m         samples are MSB first\n");
+    fprintf(stderr, "  -s         samples are signed\n");
+    fprintf(stderr, "  -3         24 bit samples are stored in 3 bytes\n");
+    fprintf(stderr, "  -S BYTES   code only the first BYTES of FILE "
+            "(default 262144)\n");
+    fprintf(stderr, "  -f FORMAT  csv (default), json or table\n");
+    fprintf(stderr, "  -o FILE    write results to FILE instead of stdout\n");
+    fprintf(stderr, "  -b FILE    compare with baseline CSV FILE. If FILE\n");
+    fprintf(stderr, "             does not exist, the results are written\n");
+    fprintf(stderr, "             to it\n");
+    fprintf(stderr, "  -t TOL     tolerated loss of throughput (default 0.2)\n");
+    fprintf(stderr, "  -R N       runs per measurement (default 5)\n");
+    fprintf(stderr, "  -T SECONDS minimum duration of a run "
+            "(default 0.01)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct aec_stream param;
+    struct result *results = NULL, *base = NULL;
+    unsigned char *src = NULL, *ref = NULL, *rz = NULL, *dec = NULL;
+    double *t = NULL;
+    const char *format = "csv";
+    const char *outfn = NULL, *basefn = NULL;
+    double tol = 0.2;
+    double min_time = 0.01;
+    size_t chunks[MAX_CHUNKS];
+    size_t len = 262144, ref_len, rz_max, nchunks, n = 0, nbase = 0;
+    int runs = 5;
+    int status = 1;
+    int opt;
+    FILE *fp;
+
+    param.bits_per_sample = 16;
+    param.block_size = 16;
+    param.rsi = 128;
+    param.flags = AEC_DATA_PREPROCESS;
+
+    for (opt = 1; opt < argc && argv[opt][0] == '-'; opt++) {
+        char o = argv[opt][1];
+        if (o == 'N') {
+            param.flags &= ~AEC_DATA_PREPROCESS;
+        } else if (o == 'm') {
+            param.flags |= AEC_DATA_MSB;
+        } else if (o == 's') {
+            param.flags |= AEC_DATA_SIGNED;
+        } else if (o == '3') {
+            param.flags |= AEC_DATA_3BYTE;
+        } else if (o && strchr("njrSfobtRT", o) && opt + 1 < argc) {
+            const char *v = argv[++opt];
+            if (o == 'n')
+                param.bits_per_sample = atoi(v);
+            else if (o == 'j')
+                param.block_size = atoi(v);
+            else if (o == 'r')
+                param.rsi = atoi(v);
+            else if (o == 'S')
+                len = (size_t)atol(v);
+            else if (o == 'f')
+                format = v;
+            else if (o == 'o')
+                outfn = v;
+            else if (o == 'b')
+                basefn = v;
+            else if (o == 't')
+                tol = atof(v);
+            else if (o == 'R')
+                runs = atoi(v);
+            else
+                min_time = atof(v);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt + 1 != argc || runs < 1
+        || (strcmp(format, "csv") && strcmp(format, "json")
+            && strcmp(format, "table"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ((fp = fopen(argv[opt], "rb")) == NULL) {
+        fprintf(stderr, "Can't open %s\n", argv[opt]);
+        return 1;
+    }
+    fseek(fp, 0L, SEEK_END);
+    if ((size_t)ftell(fp) < len)
+        len = (size_t)ftell(fp);
+    len -= len % sample_size(&param);
+    if (len == 0) {
+        fclose(fp);
+        fprintf(stderr, "No samples in %s\n", argv[opt]);
+        return 1;
+    }
+    fseek(fp, 0L, SEEK_SET);
+    rz_max = len * 2 + 1024;
+    src = malloc(len);
+    ref = malloc(rz_max);
+    rz = malloc(rz_max);
+    dec = malloc(len);
+    results = malloc(MAX_RESULTS * sizeof(struct result));
+    base = malloc(MAX_RESULTS * sizeof(struct result));
+    t = malloc(runs * sizeof(double));
+    if (src == NULL || ref == NULL || rz == NULL || dec == NULL
+        || results == NULL || base == NULL || t == NULL) {
+        fclose(fp);
+        fprintf(stderr, "Not enough memory\n");
+        goto DESTRUCT;
+    }
+    if (fread(src, 1, len, fp) != len) {
+        fclose(fp);
+        fprintf(stderr, "Can't read %s\n", argv[opt]);
+        goto DESTRUCT;
+    }
+    fclose(fp);
+
+    /* The reference stream from a single call */
+    param.next_in = src;
+    param.avail_in = len;
+    param.next_out = ref;
+    param.avail_out = rz_max;
+    if (aec_buffer_encode(&param) != AEC_OK) {
+        fprintf(stderr, "Can't encode %s\n", argv[opt]);
+        goto DESTRUCT;
+    }
+    ref_len = param.total_out;
+
+    nchunks = chunk_sizes(chunks, len > ref_len ? len : ref_len);
+    for (size_t i = 0; i < nchunks; i++) {
+        for (size_t o = 0; o < nchunks; o++) {
+            struct result *res = &results[n++];
+
+            res->in_chunk = chunks[i];
+            res->out_chunk = chunks[o];
+            if (measure(&param, res, src, len, ref, ref_len, rz, dec,
+                        t, runs, min_time) != AEC_OK) {
+                fprintf(stderr, "chunks in %zu out %zu failed\n",
+                        res->in_chunk, res->out_chunk);
+                goto DESTRUCT;
+            }
+        }
+    }
+
+    if (outfn) {
+        if ((fp = fopen(outfn, "w")) == NULL) {
+            fprintf(stderr, "Can't open %s\n", outfn);
+            goto DESTRUCT;
+        }
+    } else {
+        fp = stdout;
+    }
+    if (strcmp(format, "json") == 0)
+        write_json(fp, results, n);
+    else if (strcmp(format, "table") == 0)
+        write_table(fp, results, chunks, nchunks);
+    else
+        write_csv(fp, results, n);
+    if (outfn)
+        fclose(fp);
+    status = 0;
+
+    if (basefn) {
+        if ((fp = fopen(basefn, "r")) != NULL) {
+            nbase = read_csv(fp, base, MAX_RESULTS);
+            fclose(fp);
+            if (compare(results, n, base, nbase, tol))
+                status = 1;
+        } else if ((fp = fopen(basefn, "w")) != NULL) {
+            fprintf(stderr, "No baseline, writing %s\n", basefn);
+            write_csv(fp, results, n);
+            fclose(fp);
+        } else {
+            fprintf(stderr, "Can't write %s\n", basefn);
+            status = 1;
+        }
+    }
+
+DESTRUCT:
+    free(results);
+    free(base);
+    free(src);
+    free(ref);
+    free(rz);
+    free(dec);
+    free(t);
+    return status;
+}
@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define N_SAMPLES (64 * 64 + 17)
+
+static int host_is_msb(void)
+{
+    uint16_t x = 1;
+    unsigned char b;
+    memcpy(&b, &x, 1);
+    return b == 0;
+}
+
+static int encode_reference(struct aec_stream *strm, const int32_t *x,
+                            int size, unsigned char *dest,
+                            size_t dest_len)
+{
+    /* Encode the same values as a byte stream in host order. Only the
+     * lower bits_per_sample bits are stored. */
+    unsigned char *buf;
+    uint32_t mask = UINT32_MAX >> (32 - strm->bits_per_sample);
+    int status;
+
+    buf = malloc(N_SAMPLES * size);
+    if (buf == NULL)
+        return AEC_MEM_ERROR;
+
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        uint32_t y = (uint32_t)x[i] & mask;
+        for (int j = 0; j < size; j++) {
+            int b = strm->flags & AEC_DATA_MSB ? size - 1 - j : j;
+            buf[size * i + b] = (unsigned char)(y >> (8 * j));
+        }
+    }
+
+    strm->next_in = buf;
+    strm->avail_in = N_SAMPLES * size;
+    strm->next_out = dest;
+    strm->avail_out = dest_len;
+    status = aec_buffer_encode(strm);
+    free(buf);
+    return status;
+}
+
+static int check_native(struct aec_stream *strm, const int32_t *x,
+                        int size, int is_signed, unsigned char *cref,
+                        unsigned char *cbuf, size_t cbuf_len)
+{
+    int status;
+    size_t ref_len;
+    int32_t *src, *dst;
+
+    src = malloc(N_SAMPLES * 4);
+    dst = malloc(N_SAMPLES * 4);
+    if (src == NULL || dst == NULL) {
+        status = AEC_MEM_ERROR;
+        goto DESTRUCT;
+    }
+
+    strm->flags = AEC_DATA_PREPROCESS
+        | (is_signed ? AEC_DATA_SIGNED : 0)
+        | (host_is_msb() ? AEC_DATA_MSB : 0);
+    status = encode_reference(strm, x, size, cref, cbuf_len);
+    if (status != AEC_OK)
+        goto DESTRUCT;
+    ref_len = strm->total_out;
+
+    /* The native functions have to figure out signedness and byte
+     * order themselves. */
+    strm->flags = AEC_DATA_PREPROCESS | AEC_DATA_MSB | AEC_DATA_3BYTE;
+    strm->next_out = cbuf;
+    strm->avail_out = cbuf_len;
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        if (size == 1)
+            ((int8_t *)src)[i] = (int8_t)x[i];
+        else if (size == 2)
+            ((int16_t *)src)[i] = (int16_t)x[i];
+        else
+            src[i] = x[i];
+    }
+    if (size == 1)
+        status = is_signed
+            ? aec_encode_i8(strm, (int8_t *)src, N_SAMPLES)
+            : aec_encode_u8(strm, (uint8_t *)src, N_SAMPLES);
+    else if (size == 2)
+        status = is_signed
+            ? aec_encode_i16(strm, (int16_t *)src, N_SAMPLES)
+            : aec_encode_u16(strm, (uint16_t *)src, N_SAMPLES);
+    else
+        status = is_signed
+            ? aec_encode_i32(strm, src, N_SAMPLES)
+            : aec_encode_u32(strm, (uint32_t *)src, N_SAMPLES);
+    if (status != AEC_OK)
+        goto DESTRUCT;
+
+    if (strm->total_out != ref_len || memcmp(cref, cbuf, ref_len)) {
+        printf("%s: native encoding differs from reference.\n",
+               CHECK_FAIL);
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    strm->flags = AEC_DATA_PREPROCESS;
+    strm->next_in = cbuf;
+    strm->avail_in = ref_len;
+    if (size == 1)
+        status = is_signed
+            ? aec_decode_i8(strm, (int8_t *)dst, N_SAMPLES)
+            : aec_decode_u8(strm, (uint8_t *)dst, N_SAMPLES);
+    else if (size == 2)
+        status = is_signed
+            ? aec_decode_i16(strm, (int16_t *)dst, N_SAMPLES)
+            : aec_decode_u16(strm, (uint16_t *)dst, N_SAMPLES);
+    else
+        status = is_signed
+            ? aec_decode_i32(strm, dst, N_SAMPLES)
+            : aec_decode_u32(strm, (uint32_t *)dst, N_SAMPLES);
+    if (status != AEC_OK)
+        goto DESTRUCT;
+
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        int32_t y;
+        if (size == 1)
+            y = is_signed ? ((int8_t *)dst)[i] : ((uint8_t *)dst)[i];
+        else if (size == 2)
+            y = is_signed ? ((int16_t *)dst)[i] : ((uint16_t *)dst)[i];
+        else
+            y = dst[i];
+        if (y != x[i]) {
+            printf("%s: native decoding wrong at sample %zu.\n",
+                   CHECK_FAIL, i);
+            status = 99;
+            goto DESTRUCT;
+        }
+    }
+
+DESTRUCT:
+    free(src);
+    free(dst);
+    return status;
+}
+
+int main(void)
+{
+    int status = 0;
+    struct aec_stream strm;
+    int32_t *x;
+    unsigned char *cref, *cbuf;
+    size_t cbuf_len = N_SAMPLES * 8;
+    int bps_list[] = {5, 8, 12, 16, 23, 32};
+
+    x = malloc(N_SAMPLES * sizeof(int32_t));
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    if (x == NULL || cref == NULL || cbuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    strm.block_size = 16;
+    strm.rsi = 64;
+
+    for (int b = 0; b < 6; b++) {
+        int bps = bps_list[b];
+        int size = bps > 16 ? 4 : bps > 8 ? 2 : 1;
+        strm.bits_per_sample = bps;
+
+        for (int is_signed = 0; is_signed < 2; is_signed++) {
+            int64_t lo = is_signed ? -(INT64_C(1) << (bps - 1)) : 0;
+            int64_t range = INT64_C(1) << bps;
+
+            /* Slowly varying values covering the full range */
+            for (size_t i = 0; i < N_SAMPLES; i++)
+                x[i] = (int32_t)(lo + (int64_t)((i * 7 + (i % 13) * 3)
+                                                * (range / 64 + 1))
+                                 % range);
+
+            printf("Checking native %s%2i with %2i bits ... ",
+                   is_signed ? "i" : "u", 8 * size, bps);
+            status = check_native(&strm, x, size, is_signed,
+                                  cref, cbuf, cbuf_len);
+            if (status)
+                goto DESTRUCT;
+            printf("%s\n", CHECK_PASS);
+        }
+    }
+
+DESTRUCT:
+    free(x);
+    free(cref);
+    free(cbuf);
+    return status;
+}
@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define N_WORDS (64 * 64 + 17)
+#define TAIL 3
+
+static void to_planes(unsigned char *dest, const unsigned char *src,
+                      size_t words, size_t wordsize)
+{
+    for (size_t i = 0; i < words; i++)
+        for (size_t j = 0; j < wordsize; j++)
+            dest[j * words + i] = src[i * wordsize + j];
+    memcpy(dest + words * wordsize, src + words * wordsize, TAIL);
+}
+
+static int encode_planes(struct aec_stream *strm, const unsigned char *src,
+                         size_t wordsize, size_t chunk,
+                         unsigned char *dest, size_t dest_len)
+{
+    size_t len = N_WORDS * wordsize + TAIL;
+    size_t fed = 0;
+    int status;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    strm->next_in = src;
+    status = aec_encode_set_planes(strm, wordsize, N_WORDS);
+    if (status != AEC_OK)
+        return status;
+
+    strm->avail_in = 0;
+    strm->next_out = dest;
+    strm->avail_out = dest_len;
+    while (fed < len) {
+        size_t m = len - fed < chunk ? len - fed : chunk;
+        strm->avail_in += m;
+        fed += m;
+        status = aec_encode(strm, fed == len ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_encode_end(strm);
+}
+
+static int decode_planes(struct aec_stream *strm, const unsigned char *src,
+                         size_t src_len, size_t wordsize, size_t chunk,
+                         unsigned char *dest)
+{
+    size_t len = N_WORDS * wordsize + TAIL;
+    int status;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    strm->next_out = dest;
+    status = aec_decode_set_planes(strm, wordsize, N_WORDS);
+    if (status != AEC_OK)
+        return status;
+
+    strm->next_in = src;
+    strm->avail_in = src_len;
+    while (strm->total_out < len) {
+        size_t m = len - strm->total_out;
+        strm->avail_out = m < chunk ? m : chunk;
+        status = aec_decode(strm, AEC_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_decode_end(strm);
+}
+
+int main(void)
+{
+    int status = 0;
+    struct aec_stream strm;
+    unsigned char *src, *planes, *cref, *cbuf, *obuf;
+    size_t len = N_WORDS * 8 + TAIL;
+    size_t ref_len;
+    size_t cbuf_len = len * 2;
+
+    src = malloc(len);
+    planes = malloc(len);
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    obuf = malloc(len);
+    if (src == NULL || planes == NULL || cref == NULL || cbuf == NULL
+        || obuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* Little endian doubles of a smooth function */
+    for (size_t i = 0; i < N_WORDS; i++) {
+        uint64_t x = UINT64_C(0x4059000000000000) + (uint64_t)i * i * 977;
+        for (int j = 0; j < 8; j++)
+            src[8 * i + j] = (unsigned char)(x >> (8 * j));
+    }
+    memset(src + N_WORDS * 8, 0x5a, TAIL);
+
+    strm.bits_per_sample = 8;
+    strm.block_size = 16;
+    strm.rsi = 128;
+    strm.flags = AEC_DATA_PREPROCESS;
+
+    for (size_t wordsize = 2; wordsize <= 8; wordsize *= 2) {
+        printf("Checking byte planes of %zu byte words ... ", wordsize);
+        to_planes(planes, src, N_WORDS, wordsize);
+        strm.next_in = planes;
+        strm.avail_in = N_WORDS * wordsize + TAIL;
+        strm.next_out = cref;
+        strm.avail_out = cbuf_len;
+        status = aec_buffer_encode(&strm);
+        if (status != AEC_OK)
+            goto DESTRUCT;
+        ref_len = strm.total_out;
+
+        for (size_t chunk = 5; chunk < len; chunk *= 19) {
+            status = encode_planes(&strm, src, wordsize, chunk,
+                                   cbuf, cbuf_len);
+            if (status != AEC_OK)
+                goto DESTRUCT;
+            if (strm.total_out != ref_len || memcmp(cref, cbuf, ref_len)) {
+                printf("%s: byte plane encoding differs from reference.\n",
+                       CHECK_FAIL);
+                status = 99;
+                goto DESTRUCT;
+            }
+
+            memset(obuf, 0, len);
+            status = decode_planes(&strm, cref, ref_len, wordsize, chunk,
+                                   obuf);
+            if (status != AEC_OK)
+                goto DESTRUCT;
+            if (memcmp(src, obuf, N_WORDS * wordsize + TAIL)) {
+                printf("%s: byte plane decoding differs from input.\n",
+                       CHECK_FAIL);
+                status = 99;
+                goto DESTRUCT;
+            }
+        }
+        printf("%s\n", CHECK_PASS);
+    }
+
+DESTRUCT:
+    free(src);
+    free(planes);
+    free(cref);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
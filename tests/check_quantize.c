@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define N_SAMPLES (64 * 64 + 17)
+
+static int encode_reference(struct aec_stream *strm,
+                            const double *source, size_t n,
+                            unsigned char *dest, size_t dest_len,
+                            double reference, double decimal,
+                            double divisor)
+{
+    /* Quantise into a temporary integer buffer and encode that. */
+    unsigned char *buf;
+    int status;
+    long long int qmin, qmax;
+    int size;
+
+    if (strm->flags & AEC_DATA_SIGNED) {
+        qmin = -(1LL << (strm->bits_per_sample - 1));
+        qmax = (1LL << (strm->bits_per_sample - 1)) - 1;
+    } else {
+        qmin = 0;
+        qmax = (1LL << strm->bits_per_sample) - 1;
+    }
+
+    if (strm->bits_per_sample > 16)
+        size = 4;
+    else if (strm->bits_per_sample > 8)
+        size = 2;
+    else
+        size = 1;
+
+    buf = malloc(n * size);
+    if (buf == NULL)
+        return AEC_MEM_ERROR;
+
+    for (size_t i = 0; i < n; i++) {
+        double q = (source[i] * decimal - reference) * divisor;
+        long long int y;
+        if (q < (double)qmin)
+            y = qmin;
+        else if (q > (double)qmax)
+            y = qmax;
+        else
+            y = (long long int)(q - (double)qmin + 0.5) + qmin;
+        y &= (1LL << strm->bits_per_sample) - 1;
+        for (int j = 0; j < size; j++)
+            buf[size * i + j] = (unsigned char)(y >> (8 * j));
+    }
+
+    strm->next_in = buf;
+    strm->avail_in = n * size;
+    strm->next_out = dest;
+    strm->avail_out = dest_len;
+    status = aec_buffer_encode(strm);
+    free(buf);
+    return status;
+}
+
+static int check_quantize(struct aec_stream *strm, const double *source,
+                          const float *fsource,
+                          unsigned char *cref, unsigned char *cbuf,
+                          size_t cbuf_len)
+{
+    /* With fsource the float array is encoded. source then holds the
+     * same values as double for the reference. */
+    int status;
+    size_t ref_len;
+
+    status = encode_reference(strm, source, N_SAMPLES, cref, cbuf_len,
+                              1000.0, 100.0, 0.25);
+    if (status != AEC_OK)
+        return status;
+    ref_len = strm->total_out;
+
+    strm->next_out = cbuf;
+    strm->avail_out = cbuf_len;
+    if (fsource)
+        status = aec_encode_float(strm, fsource, N_SAMPLES, 1000.0, 2, 2);
+    else
+        status = aec_encode_double(strm, source, N_SAMPLES, 1000.0, 2, 2);
+    if (status != AEC_OK)
+        return status;
+
+    if (strm->total_out != ref_len || memcmp(cref, cbuf, ref_len)) {
+        printf("%s: quantised encoding differs from reference.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int status = 0;
+    struct aec_stream strm;
+    double *source, *fwide;
+    float *fsource;
+    unsigned char *cref, *cbuf;
+    size_t cbuf_len = N_SAMPLES * 8;
+
+    source = malloc(N_SAMPLES * sizeof(double));
+    fwide = malloc(N_SAMPLES * sizeof(double));
+    fsource = malloc(N_SAMPLES * sizeof(float));
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    if (source == NULL || fwide == NULL || fsource == NULL
+        || cref == NULL || cbuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* A smooth field with some values out of range at both ends */
+    for (int i = 0; i < N_SAMPLES; i++)
+        source[i] = (double)((i * 37) % 1001) - 100.0 + (double)i / 7.0;
+    for (int i = 0; i < N_SAMPLES; i++) {
+        fsource[i] = (float)source[i];
+        fwide[i] = fsource[i];
+    }
+
+    strm.block_size = 16;
+    strm.rsi = 64;
+
+    for (int bps = 8; bps <= 32; bps += 8) {
+        strm.bits_per_sample = bps;
+        strm.flags = AEC_DATA_PREPROCESS;
+        printf("Checking quantised encoding of %2i bit unsigned ... ", bps);
+        status = check_quantize(&strm, source, NULL, cref, cbuf, cbuf_len);
+        if (status)
+            goto DESTRUCT;
+        printf("%s\n", CHECK_PASS);
+
+        printf("Checking quantised float encoding of %2i bit unsigned ... ",
+               bps);
+        status = check_quantize(&strm, fwide, fsource, cref, cbuf, cbuf_len);
+        if (status)
+            goto DESTRUCT;
+        printf("%s\n", CHECK_PASS);
+
+        strm.flags = AEC_DATA_PREPROCESS | AEC_DATA_SIGNED;
+        printf("Checking quantised encoding of %2i bit signed ... ", bps);
+        status = check_quantize(&strm, source, NULL, cref, cbuf, cbuf_len);
+        if (status)
+            goto DESTRUCT;
+        printf("%s\n", CHECK_PASS);
+
+        printf("Checking quantised float encoding of %2i bit signed ... ",
+               bps);
+        status = check_quantize(&strm, fwide, fsource, cref, cbuf, cbuf_len);
+        if (status)
+            goto DESTRUCT;
+        printf("%s\n", CHECK_PASS);
+    }
+
+DESTRUCT:
+    free(source);
+    free(fwide);
+    free(fsource);
+    free(cref);
+    free(cbuf);
+    return status;
+}
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define BLOCK_SIZE 16
+#define RSI 64
+#define N_RSI 6
+#define N_SAMPLES ((N_RSI - 1) * RSI * BLOCK_SIZE + 7 * BLOCK_SIZE)
+
+struct record {
+    int n;
+    struct aec_rsi rsi[N_RSI + 1];
+    uint64_t rsis[N_RSI + 1];
+};
+
+static void record_rsi(void *opaque, const struct aec_rsi *rsi)
+{
+    struct record *rec = opaque;
+
+    if (rec->n <= N_RSI) {
+        rec->rsi[rec->n] = *rsi;
+        rec->rsis[rec->n] = rsi->stats ? rsi->stats->rsis : 0;
+    }
+    rec->n++;
+}
+
+static void init_stream(struct aec_stream *strm)
+{
+    strm->bits_per_sample = 16;
+    strm->block_size = BLOCK_SIZE;
+    strm->rsi = RSI;
+    strm->flags = AEC_DATA_PREPROCESS;
+}
+
+static int check_encoder(const struct record *rec, size_t total_out)
+{
+    uint64_t end;
+
+    printf("Checking RSIs reported by the encoder ... ");
+    if (rec->n != N_RSI) {
+        printf("%s: %i RSIs instead of %i.\n", CHECK_FAIL, rec->n, N_RSI);
+        return 99;
+    }
+    for (int i = 0; i < N_RSI; i++) {
+        const struct aec_rsi *r = &rec->rsi[i];
+        uint64_t start = i ? rec->rsi[i - 1].bit_offset
+            + rec->rsi[i - 1].bits : 0;
+
+        if (r->index != (size_t)i
+            || r->in_offset != (size_t)i * RSI * BLOCK_SIZE * 2
+            || r->bit_offset != start
+            || r->out_offset != r->bit_offset / 8
+            || rec->rsis[i] != (uint64_t)i + 1) {
+            printf("%s: RSI %i reported wrong.\n", CHECK_FAIL, i);
+            return 99;
+        }
+    }
+    end = rec->rsi[N_RSI - 1].bit_offset + rec->rsi[N_RSI - 1].bits;
+    if (end > total_out * 8 || end + 8 <= total_out * 8) {
+        printf("%s: last RSI ends at bit %llu of %llu bytes.\n",
+               CHECK_FAIL, (unsigned long long)end,
+               (unsigned long long)total_out);
+        return 99;
+    }
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_decoder(const struct record *expected,
+                         unsigned char *src, size_t src_len,
+                         unsigned char *dest, size_t dest_len,
+                         size_t chunk, int threads)
+{
+    /* The decoder reports the same RSIs with input and output
+     * swapped, also when the input arrives in small chunks */
+    struct aec_stream strm;
+    struct record rec;
+    int status;
+
+    rec.n = 0;
+    init_stream(&strm);
+    strm.next_in = src;
+    strm.avail_in = 0;
+    strm.next_out = dest;
+    strm.avail_out = dest_len;
+
+    printf("Checking RSIs reported by the decoder with %i threads and "
+           "%llu byte chunks ... ", threads, (unsigned long long)chunk);
+    status = aec_decode_init(&strm);
+    if (status == AEC_OK)
+        status = aec_decode_set_threads(&strm, threads);
+    if (status == AEC_OK)
+        status = aec_decode_set_rsi_callback(&strm, record_rsi, &rec);
+    while (status == AEC_OK && src_len) {
+        strm.avail_in = chunk < src_len ? chunk : src_len;
+        src_len -= strm.avail_in;
+        status = aec_decode(&strm, AEC_NO_FLUSH);
+        src_len += strm.avail_in;
+    }
+    if (status == AEC_OK && rec.n != N_RSI - 1) {
+        printf("%s: last RSI reported before the end.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (status == AEC_OK)
+        status = aec_decode(&strm, AEC_FLUSH);
+    aec_decode_end(&strm);
+    if (status != AEC_OK) {
+        printf("%s: decoding failed (%i).\n", CHECK_FAIL, status);
+        return 99;
+    }
+    if (rec.n != N_RSI) {
+        printf("%s: %i RSIs instead of %i.\n", CHECK_FAIL, rec.n, N_RSI);
+        return 99;
+    }
+    for (int i = 0; i < N_RSI; i++) {
+        const struct aec_rsi *r = &rec.rsi[i];
+        const struct aec_rsi *e = &expected->rsi[i];
+
+        if (r->index != e->index
+            || r->in_offset != e->out_offset
+            || r->out_offset != e->in_offset
+            || r->bit_offset != e->bit_offset
+            || r->bits != e->bits
+            || r->stats != NULL) {
+            printf("%s: RSI %i differs from the encoder's.\n",
+                   CHECK_FAIL, i);
+            return 99;
+        }
+    }
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+int main(void)
+{
+    struct aec_stream strm;
+    struct aec_stats stats;
+    struct record rec;
+    unsigned char *src, *dest;
+    size_t len = N_SAMPLES * 2;
+    size_t dest_len = len * 2;
+    int status = 0;
+
+    src = malloc(len);
+    dest = malloc(dest_len);
+    if (src == NULL || dest == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* Noise and zeros of varying length so that RSIs differ */
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        uint32_t x = (uint32_t)(i * 2654435761u >> 7);
+        if ((i / BLOCK_SIZE) % ((i / (RSI * BLOCK_SIZE)) + 2) == 0)
+            x = 0;
+        src[2 * i] = (unsigned char)x;
+        src[2 * i + 1] = (unsigned char)(x >> 8);
+    }
+
+    rec.n = 0;
+    init_stream(&strm);
+    strm.next_in = src;
+    strm.avail_in = len;
+    strm.next_out = dest;
+    strm.avail_out = dest_len;
+    status = aec_encode_init(&strm);
+    if (status == AEC_OK)
+        status = aec_encode_set_stats(&strm, &stats);
+    if (status == AEC_OK)
+        status = aec_encode_set_rsi_callback(&strm, record_rsi, &rec);
+    if (status == AEC_OK)
+        status = aec_encode(&strm, AEC_FLUSH);
+    if (status == AEC_OK)
+        status = aec_encode_end(&strm);
+    if (status != AEC_OK) {
+        printf("Encoding failed (%i).\n", status);
+        goto DESTRUCT;
+    }
+
+    status = check_encoder(&rec, strm.total_out);
+    if (status == 0)
+        status = check_decoder(&rec, dest, strm.total_out, src, len,
+                               strm.total_out, 4);
+    if (status == 0)
+        status = check_decoder(&rec, dest, strm.total_out, src, len, 3, 1);
+
+DESTRUCT:
+    free(src);
+    free(dest);
+    return status;
+}
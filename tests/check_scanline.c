@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define SCANLINE 1000
+#define N_SAMPLES (7 * SCANLINE + 123)
+
+static size_t pad_buffer(unsigned char *dest, const unsigned char *src,
+                         size_t n, size_t rsi_samples, int pad)
+{
+    /* Copy scanlines of 16 bit samples and pad them to full RSIs. */
+    size_t j = 0;
+
+    for (size_t i = 0; i < n; i += SCANLINE) {
+        size_t len = n - i < SCANLINE ? n - i : SCANLINE;
+        memcpy(dest + 2 * j, src + 2 * i, 2 * len);
+        for (size_t k = len; k < rsi_samples; k++) {
+            if (pad == AEC_PAD_LAST)
+                memcpy(dest + 2 * (j + k), src + 2 * (i + len - 1), 2);
+            else
+                memset(dest + 2 * (j + k), 0, 2);
+        }
+        j += rsi_samples;
+    }
+    return j;
+}
+
+static int encode_scanlines(struct aec_stream *strm,
+                            const unsigned char *src, size_t n,
+                            size_t chunk, int pad,
+                            unsigned char *dest, size_t dest_len)
+{
+    size_t fed = 0;
+    int status;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    status = aec_encode_set_scanline(strm, SCANLINE, pad);
+    if (status != AEC_OK)
+        return status;
+
+    strm->next_in = src;
+    strm->avail_in = 0;
+    strm->next_out = dest;
+    strm->avail_out = dest_len;
+    while (fed < 2 * n) {
+        size_t m = 2 * n - fed < chunk ? 2 * n - fed : chunk;
+        strm->avail_in += m;
+        fed += m;
+        status = aec_encode(strm, fed == 2 * n ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_encode_end(strm);
+}
+
+static int decode_scanlines(struct aec_stream *strm,
+                            const unsigned char *src, size_t src_len,
+                            size_t chunk, unsigned char *dest, size_t n)
+{
+    int status;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    status = aec_decode_set_scanline(strm, SCANLINE);
+    if (status != AEC_OK)
+        return status;
+
+    strm->next_in = src;
+    strm->avail_in = src_len;
+    strm->next_out = dest;
+    while (strm->total_out < 2 * n) {
+        size_t m = 2 * n - strm->total_out;
+        strm->avail_out = m < chunk ? m : chunk;
+        status = aec_decode(strm, AEC_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_decode_end(strm);
+}
+
+int main(void)
+{
+    int status = 0;
+    struct aec_stream strm;
+    unsigned char *src, *padded, *cref, *cbuf, *obuf;
+    size_t rsi_samples, padded_len, ref_len;
+    size_t cbuf_len = N_SAMPLES * 8;
+    int pads[] = {AEC_PAD_LAST, AEC_PAD_ZERO};
+
+    strm.bits_per_sample = 16;
+    strm.block_size = 16;
+    strm.rsi = (SCANLINE + strm.block_size - 1) / strm.block_size;
+    rsi_samples = strm.rsi * strm.block_size;
+
+    src = malloc(N_SAMPLES * 2);
+    padded = malloc(N_SAMPLES * 4);
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    obuf = malloc(N_SAMPLES * 2);
+    if (src == NULL || padded == NULL || cref == NULL || cbuf == NULL
+        || obuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        uint32_t x = (uint32_t)(40000 + (i % SCANLINE) * 11 + i / 97);
+        src[2 * i] = (unsigned char)x;
+        src[2 * i + 1] = (unsigned char)(x >> 8);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        for (int pp = 0; pp < 2; pp++) {
+            strm.flags = pp ? AEC_DATA_PREPROCESS : 0;
+            padded_len = pad_buffer(padded, src, N_SAMPLES, rsi_samples,
+                                    pads[p]);
+            strm.next_in = padded;
+            strm.avail_in = padded_len * 2;
+            strm.next_out = cref;
+            strm.avail_out = cbuf_len;
+            status = aec_buffer_encode(&strm);
+            if (status != AEC_OK)
+                goto DESTRUCT;
+            ref_len = strm.total_out;
+
+            printf("Checking scanline padding %s, pp %i ... ",
+                   pads[p] == AEC_PAD_LAST ? "last" : "zero", pp);
+            for (size_t chunk = 3; chunk < N_SAMPLES * 2; chunk *= 17) {
+                status = encode_scanlines(&strm, src, N_SAMPLES, chunk,
+                                          pads[p], cbuf, cbuf_len);
+                if (status != AEC_OK)
+                    goto DESTRUCT;
+                if (strm.total_out != ref_len
+                    || memcmp(cref, cbuf, ref_len)) {
+                    printf("%s: padded encoding differs from reference.\n",
+                           CHECK_FAIL);
+                    status = 99;
+                    goto DESTRUCT;
+                }
+
+                /* Chunks of whole samples */
+                status = decode_scanlines(&strm, cref, ref_len,
+                                          chunk & ~(size_t)1, obuf,
+                                          N_SAMPLES);
+                if (status != AEC_OK)
+                    goto DESTRUCT;
+                if (memcmp(src, obuf, N_SAMPLES * 2)) {
+                    printf("%s: padding not removed correctly.\n",
+                           CHECK_FAIL);
+                    status = 99;
+                    goto DESTRUCT;
+                }
+            }
+            printf("%s\n", CHECK_PASS);
+        }
+    }
+
+DESTRUCT:
+    free(src);
+    free(padded);
+    free(cref);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define BLOCK_SIZE 16
+#define RSI 64
+/* The short last RSI must not end in a zero run for the decoder
+ * to count the same as the encoder */
+#define N_BLOCKS (4 * RSI * 10 + RSI + 7)
+#define N_SAMPLES (N_BLOCKS * BLOCK_SIZE)
+
+static uint64_t sum(const uint64_t *v, int n)
+{
+    uint64_t s = 0;
+    for (int i = 0; i < n; i++)
+        s += v[i];
+    return s;
+}
+
+static int check_decode(unsigned char *src, size_t src_len,
+                        unsigned char *dest, size_t dest_len,
+                        const struct aec_stats *expected, size_t chunk,
+                        int threads)
+{
+    /* The decoder has to count the same as the encoder, also when
+     * the input arrives in small chunks */
+    struct aec_stream strm;
+    struct aec_stats stats;
+    int status;
+
+    strm.bits_per_sample = 16;
+    strm.block_size = BLOCK_SIZE;
+    strm.rsi = RSI;
+    strm.flags = AEC_DATA_PREPROCESS;
+    strm.next_in = src;
+    strm.avail_in = 0;
+    strm.next_out = dest;
+    strm.avail_out = dest_len;
+
+    printf("Checking decoder statistics with %i threads and "
+           "%llu byte chunks ... ", threads, (unsigned long long)chunk);
+    status = aec_decode_init(&strm);
+    if (status == AEC_OK)
+        status = aec_decode_set_threads(&strm, threads);
+    if (status == AEC_OK)
+        status = aec_decode_set_stats(&strm, &stats);
+    while (status == AEC_OK && src_len) {
+        strm.avail_in = chunk < src_len ? chunk : src_len;
+        src_len -= strm.avail_in;
+        status = aec_decode(&strm, AEC_NO_FLUSH);
+        src_len += strm.avail_in;
+    }
+    if (status == AEC_OK)
+        status = aec_decode(&strm, AEC_FLUSH);
+    aec_decode_end(&strm);
+    if (status != AEC_OK) {
+        printf("%s: decoding failed (%i).\n", CHECK_FAIL, status);
+        return 99;
+    }
+    if (memcmp(&stats, expected, sizeof(stats)) != 0) {
+        printf("%s: statistics differ from the encoder's.\n", CHECK_FAIL);
+        return 99;
+    }
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_stats(const struct aec_stream *strm,
+                       const struct aec_stats *stats, int threads)
+{
+    uint64_t blocks = stats->zero_blocks + stats->se_blocks
+        + sum(stats->split_blocks, AEC_STATS_MAX_K) + stats->uncomp_blocks;
+    uint64_t cdss = sum(stats->zero_runs, AEC_STATS_MAX_RUN)
+        + stats->se_blocks + sum(stats->split_blocks, AEC_STATS_MAX_K)
+        + stats->uncomp_blocks;
+    uint64_t bits = stats->zero_bits + stats->se_bits
+        + sum(stats->split_bits, AEC_STATS_MAX_K) + stats->uncomp_bits;
+    uint64_t runs = 0;
+    uint64_t id_bits = 0;
+
+    for (int i = 0; i < AEC_STATS_MAX_RUN; i++)
+        runs += (uint64_t)(i + 1) * stats->zero_runs[i];
+
+    /* Every CDS has a 4 bit ID at 16 bit, SE and zero one more */
+    id_bits = 4 * cdss + stats->se_blocks
+        + sum(stats->zero_runs, AEC_STATS_MAX_RUN);
+
+    printf("Checking statistics with %i threads ... ", threads);
+    if (blocks != N_BLOCKS) {
+        printf("%s: counted %llu blocks instead of %i.\n",
+               CHECK_FAIL, (unsigned long long)blocks, N_BLOCKS);
+        return 99;
+    }
+    if (runs != stats->zero_blocks) {
+        printf("%s: zero runs don't add up.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (stats->zero_runs[RSI - 1] == 0 || stats->se_blocks == 0
+        || sum(stats->split_blocks, AEC_STATS_MAX_K) == 0) {
+        printf("%s: code option missing.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (bits > strm->total_out * 8 || bits + 8 <= strm->total_out * 8) {
+        printf("%s: counted %llu bits for %llu bytes of output.\n",
+               CHECK_FAIL, (unsigned long long)bits,
+               (unsigned long long)strm->total_out);
+        return 99;
+    }
+    if (stats->id_bits != id_bits) {
+        printf("%s: counted %llu ID bits instead of %llu.\n", CHECK_FAIL,
+               (unsigned long long)stats->id_bits,
+               (unsigned long long)id_bits);
+        return 99;
+    }
+    if (stats->ref_bits != 16 * ((N_BLOCKS + RSI - 1) / RSI)) {
+        printf("%s: wrong number of reference sample bits.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (stats->rsis != (N_BLOCKS + RSI - 1) / RSI) {
+        printf("%s: counted %llu RSIs.\n", CHECK_FAIL,
+               (unsigned long long)stats->rsis);
+        return 99;
+    }
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+int main(void)
+{
+    struct aec_stream strm;
+    struct aec_stats stats;
+    unsigned char *src, *dest;
+    size_t len = N_SAMPLES * 2;
+    size_t dest_len = len * 2;
+    int status = 0;
+
+    src = malloc(len);
+    dest = malloc(dest_len);
+    if (src == NULL || dest == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* One RSI each of zeros, small values, noise and a ramp */
+    for (size_t i = 0; i < N_SAMPLES; i++) {
+        uint32_t x;
+        switch ((i / (RSI * BLOCK_SIZE)) % 4) {
+        case 0:
+            x = 0;
+            break;
+        case 1:
+            x = i % 7 == 0;
+            break;
+        case 2:
+            x = (uint32_t)(i * 2654435761u >> 9);
+            break;
+        default:
+            x = (uint32_t)(i / 3 + (i % 29));
+        }
+        src[2 * i] = (unsigned char)x;
+        src[2 * i + 1] = (unsigned char)(x >> 8);
+    }
+
+    for (int threads = 1; threads <= 4; threads += 3) {
+        strm.bits_per_sample = 16;
+        strm.block_size = BLOCK_SIZE;
+        strm.rsi = RSI;
+        strm.flags = AEC_DATA_PREPROCESS;
+        strm.next_in = src;
+        strm.avail_in = len;
+        strm.next_out = dest;
+        strm.avail_out = dest_len;
+
+        status = aec_encode_init(&strm);
+        if (status == AEC_OK)
+            status = aec_encode_set_threads(&strm, threads);
+        if (status == AEC_OK)
+            status = aec_encode_set_stats(&strm, &stats);
+        if (status == AEC_OK)
+            status = aec_encode(&strm, AEC_FLUSH);
+        if (status == AEC_OK)
+            status = aec_encode_end(&strm);
+        if (status != AEC_OK) {
+            printf("Encoding failed (%i).\n", status);
+            goto DESTRUCT;
+        }
+
+        status = check_stats(&strm, &stats, threads);
+        if (status == 0)
+            status = check_decode(dest, strm.total_out, src, len, &stats,
+                                  strm.total_out, threads);
+        if (status == 0)
+            status = check_decode(dest, strm.total_out, src, len, &stats,
+                                  3, threads);
+        if (status)
+            goto DESTRUCT;
+    }
+
+DESTRUCT:
+    free(src);
+    free(dest);
+    return status;
+}
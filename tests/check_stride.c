@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define N_SAMPLES (64 * 64 + 17)
+#define N_CHANNELS 3
+#define FILL 0xa5
+
+static size_t sample_size(struct aec_stream *strm)
+{
+    if (strm->bits_per_sample > 16)
+        return (strm->bits_per_sample <= 24
+                && strm->flags & AEC_DATA_3BYTE) ? 3 : 4;
+    else if (strm->bits_per_sample > 8)
+        return 2;
+    else
+        return 1;
+}
+
+static int encode_strided(struct aec_stream *strm,
+                          const unsigned char *records, size_t stride,
+                          size_t chunk, unsigned char *dest,
+                          size_t dest_len)
+{
+    /* Feed the channel at records in pieces of chunk bytes. The last
+     * sample ends without its gap. */
+    size_t len = (N_SAMPLES - 1) * stride + sample_size(strm);
+    size_t fed = 0;
+    int status;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    status = aec_encode_set_stride(strm, stride);
+    if (status != AEC_OK)
+        return status;
+
+    strm->next_in = records;
+    strm->next_out = dest;
+    strm->avail_out = dest_len;
+    strm->avail_in = 0;
+    while (fed < len) {
+        size_t n = len - fed < chunk ? len - fed : chunk;
+        /* Incomplete samples are left in avail_in */
+        strm->avail_in += n;
+        fed += n;
+        status = aec_encode(strm, fed == len ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_encode_end(strm);
+}
+
+static int decode_strided(struct aec_stream *strm,
+                          const unsigned char *source, size_t source_len,
+                          size_t stride, size_t chunk,
+                          unsigned char *records)
+{
+    /* Every piece but the last ends in the gap right after a
+     * sample. */
+    size_t len = (N_SAMPLES - 1) * stride + sample_size(strm);
+    size_t piece = chunk / stride * stride + stride;
+    size_t end = sample_size(strm);
+    int status;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    status = aec_decode_set_stride(strm, stride);
+    if (status != AEC_OK)
+        return status;
+
+    strm->next_in = source;
+    strm->avail_in = source_len;
+    strm->next_out = records;
+    while (strm->total_out < len) {
+        end += piece;
+        strm->avail_out = (end < len ? end : len) - strm->total_out;
+        status = aec_decode(strm, AEC_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_decode_end(strm);
+}
+
+static int check_channel(struct aec_stream *strm, unsigned char *records,
+                         unsigned char *ubuf, unsigned char *cref,
+                         unsigned char *cbuf, size_t cbuf_len)
+{
+    size_t size = sample_size(strm);
+    size_t stride = N_CHANNELS * size + 1;
+    size_t ref_len;
+    unsigned char *obuf = ubuf + N_SAMPLES * size;
+    int status;
+
+    /* Reference: contiguous copy of channel 1 */
+    for (size_t i = 0; i < N_SAMPLES; i++)
+        memcpy(ubuf + i * size, records + i * stride + size, size);
+
+    strm->next_in = ubuf;
+    strm->avail_in = N_SAMPLES * size;
+    strm->next_out = cref;
+    strm->avail_out = cbuf_len;
+    status = aec_buffer_encode(strm);
+    if (status != AEC_OK)
+        return status;
+    ref_len = strm->total_out;
+
+    for (size_t chunk = 7; chunk <= N_SAMPLES * stride; chunk *= 41) {
+        status = encode_strided(strm, records + size, stride, chunk,
+                                cbuf, cbuf_len);
+        if (status != AEC_OK)
+            return status;
+        if (strm->total_out != ref_len || memcmp(cref, cbuf, ref_len)) {
+            printf("%s: strided encoding differs from reference.\n",
+                   CHECK_FAIL);
+            return 99;
+        }
+
+        memset(obuf, FILL, N_SAMPLES * stride);
+        status = decode_strided(strm, cref, ref_len, stride, chunk,
+                                obuf + size);
+        if (status != AEC_OK)
+            return status;
+        for (size_t i = 0; i < N_SAMPLES * stride; i++) {
+            int expected = (i % stride) / size == 1 ? records[i] : FILL;
+            if (obuf[i] != expected) {
+                printf("%s: strided decoding wrong at byte %zu.\n",
+                       CHECK_FAIL, i);
+                return 99;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int status = 0;
+    struct aec_stream strm;
+    unsigned char *records, *ubuf, *cref, *cbuf;
+    size_t records_len = N_SAMPLES * (N_CHANNELS * 4 + 1);
+    size_t cbuf_len = records_len * 2;
+
+    records = malloc(records_len);
+    ubuf = malloc(records_len * 2);
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    if (records == NULL || ubuf == NULL || cref == NULL || cbuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    strm.block_size = 16;
+    strm.rsi = 64;
+
+    for (int bps = 8; bps <= 32; bps += 8) {
+        int flags[] = {AEC_DATA_PREPROCESS,
+                       AEC_DATA_PREPROCESS | AEC_DATA_MSB,
+                       AEC_DATA_PREPROCESS | AEC_DATA_3BYTE};
+        strm.bits_per_sample = bps;
+        for (int f = 0; f < 3; f++) {
+            uint32_t mask = UINT32_MAX >> (32 - bps);
+            strm.flags = flags[f];
+
+            /* Smooth channel between two noisy ones */
+            for (size_t i = 0; i < records_len; i++)
+                records[i] = (unsigned char)(i * 2654435761u >> 13);
+            for (size_t i = 0; i < N_SAMPLES; i++) {
+                size_t size = sample_size(&strm);
+                size_t stride = N_CHANNELS * size + 1;
+                uint32_t x = (uint32_t)(i * 3 + (i % 17)) & mask;
+                for (size_t j = 0; j < size; j++) {
+                    size_t b = strm.flags & AEC_DATA_MSB
+                        ? size - 1 - j : j;
+                    records[i * stride + size + b] =
+                        (unsigned char)(x >> (8 * j));
+                }
+            }
+
+            printf("Checking strided coding of %2i bit, flags %2i ... ",
+                   bps, strm.flags);
+            status = check_channel(&strm, records, ubuf, cref, cbuf,
+                                   cbuf_len);
+            if (status)
+                goto DESTRUCT;
+            printf("%s\n", CHECK_PASS);
+        }
+    }
+
+DESTRUCT:
+    free(records);
+    free(ubuf);
+    free(cref);
+    free(cbuf);
+    return status;
+}
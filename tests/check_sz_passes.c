@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "szlib.h"
+
+/* SZ_BufftoBuffDecompress() must decode 32 and 64 bit pixels once,
+ * also if destLen is only an upper bound of the decoded size. Calls
+ * to aec_decode() from the shared library are counted here. */
+
+#define PIXELS_PER_BLOCK 16
+#define PIXELS_PER_SCANLINE (PIXELS_PER_BLOCK * 64)
+/* Whole scanlines, the decoder would return padding otherwise */
+#define N_PIXELS (PIXELS_PER_SCANLINE * 20)
+
+static int decode_calls;
+
+int aec_decode(struct aec_stream *strm, int flush)
+{
+    static int (*next)(struct aec_stream *, int);
+
+    if (next == NULL) {
+        *(void **)&next = dlsym(RTLD_NEXT, "aec_decode");
+        if (next == NULL) {
+            fprintf(stderr, "Can't find aec_decode\n");
+            exit(99);
+        }
+    }
+    decode_calls++;
+    return next(strm, flush);
+}
+
+static int check_decompress(SZ_com_t *param, const unsigned char *src,
+                            size_t len, const unsigned char *comp,
+                            size_t comp_len, size_t extra)
+{
+    unsigned char *dest;
+    size_t dest_len = len + extra;
+    int status;
+
+    dest = malloc(dest_len);
+    if (dest == NULL)
+        return 99;
+    memset(dest, 0x55, dest_len);
+
+    decode_calls = 0;
+    status = SZ_BufftoBuffDecompress(dest, &dest_len, comp, comp_len,
+                                     param);
+    if (status != SZ_OK) {
+        fprintf(stderr, "Decompression failed: %i\n", status);
+    } else if (decode_calls != 1) {
+        fprintf(stderr, "%i bit, %zu extra bytes: decoded %i times\n",
+                param->bits_per_pixel, extra, decode_calls);
+        status = 99;
+    } else if (dest_len != len || memcmp(src, dest, len) != 0) {
+        fprintf(stderr, "%i bit, %zu extra bytes: data differ\n",
+                param->bits_per_pixel, extra);
+        status = 99;
+    }
+    free(dest);
+    return status;
+}
+
+int main(void)
+{
+    static const size_t extra[] = {0, 3, 8, 1000, 100 * 1000};
+    SZ_com_t param;
+    unsigned char *src, *comp;
+    size_t len, comp_len;
+    int status = 0;
+
+    param.options_mask = SZ_MSB_OPTION_MASK | SZ_NN_OPTION_MASK;
+    param.pixels_per_block = PIXELS_PER_BLOCK;
+    param.pixels_per_scanline = PIXELS_PER_SCANLINE;
+
+    len = N_PIXELS * 8;
+    src = malloc(len);
+    comp = malloc(len * 2);
+    if (src == NULL || comp == NULL) {
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* Smooth low bytes, mostly constant high bytes */
+    for (size_t i = 0; i < len; i++)
+        src[i] = (unsigned char)((i & 7) < 4 ? i / 8 + (i & 7) : i >> 16);
+
+    for (int bpp = 32; bpp <= 64 && status == 0; bpp += 32) {
+        size_t n = N_PIXELS * (bpp / 8);
+
+        param.bits_per_pixel = bpp;
+        comp_len = len * 2;
+        status = SZ_BufftoBuffCompress(comp, &comp_len, src, n, &param);
+        if (status != SZ_OK) {
+            fprintf(stderr, "Compression failed: %i\n", status);
+            break;
+        }
+        for (size_t i = 0; i < sizeof(extra) / sizeof(*extra); i++) {
+            status = check_decompress(&param, src, n, comp, comp_len,
+                                      extra[i]);
+            if (status != SZ_OK)
+                break;
+        }
+    }
+
+DESTRUCT:
+    free(src);
+    free(comp);
+    return status;
+}
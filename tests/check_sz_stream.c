@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "szlib.h"
+
+#define N_PIXELS (50 * 1000 + 123)
+#define IN_CHUNK 777
+#define OUT_CHUNK 100
+
+static int stream_compress(SZ_com_t *param, const unsigned char *src,
+                           size_t len, unsigned char *dest, size_t *dest_len)
+{
+    struct aec_stream strm;
+    int status;
+    size_t fed = 0;
+
+    status = SZ_StreamCompressInit(&strm, param);
+    if (status != SZ_OK)
+        return status;
+
+    strm.next_in = src;
+    strm.avail_in = 0;
+    do {
+        size_t n;
+
+        /* Incomplete samples stay in avail_in */
+        if (fed < len) {
+            n = len - fed < IN_CHUNK ? len - fed : IN_CHUNK;
+            strm.avail_in += n;
+            fed += n;
+        }
+        n = *dest_len - strm.total_out;
+        strm.next_out = dest + strm.total_out;
+        strm.avail_out = n < OUT_CHUNK ? n : OUT_CHUNK;
+        status = SZ_StreamCompress(&strm, fed == len);
+        if (status != SZ_OK)
+            return status;
+    } while (fed < len || strm.avail_out == 0);
+
+    *dest_len = strm.total_out;
+    return SZ_StreamCompressEnd(&strm);
+}
+
+static int stream_decompress(SZ_com_t *param, const unsigned char *src,
+                             size_t src_len, unsigned char *dest,
+                             size_t len)
+{
+    struct aec_stream strm;
+    int status;
+
+    status = SZ_StreamDecompressInit(&strm, param);
+    if (status != SZ_OK)
+        return status;
+
+    strm.next_in = src;
+    strm.avail_in = 0;
+    while (strm.total_out < len) {
+        size_t n;
+
+        if (strm.avail_in == 0) {
+            n = src_len - strm.total_in;
+            strm.avail_in = n < IN_CHUNK ? n : IN_CHUNK;
+        }
+        n = len - strm.total_out;
+        strm.next_out = dest + strm.total_out;
+        strm.avail_out = n < OUT_CHUNK ? n : OUT_CHUNK;
+        status = SZ_StreamDecompress(&strm);
+        if (status != SZ_OK)
+            return status;
+        if (strm.avail_in == 0 && strm.total_in == src_len
+            && strm.avail_out) {
+            printf("FAIL: stream ended early.\n");
+            return 99;
+        }
+    }
+    return SZ_StreamDecompressEnd(&strm);
+}
+
+static int check(SZ_com_t *param, const unsigned char *src, size_t len,
+                 unsigned char *ref, unsigned char *dest, size_t dest_len,
+                 unsigned char *out)
+{
+    int status;
+    size_t ref_len = dest_len;
+    size_t stream_len = dest_len;
+
+    printf("Checking streaming SZ with %2i bit, mask %3i ... ",
+           param->bits_per_pixel, param->options_mask);
+
+    status = SZ_BufftoBuffCompress(ref, &ref_len, src, len, param);
+    if (status != SZ_OK)
+        return status;
+
+    status = stream_compress(param, src, len, dest, &stream_len);
+    if (status != SZ_OK)
+        return status;
+    if (stream_len != ref_len || memcmp(ref, dest, ref_len)) {
+        printf("FAIL: streaming compression differs.\n");
+        return 99;
+    }
+
+    memset(out, 0, len);
+    status = stream_decompress(param, ref, ref_len, out, len);
+    if (status != SZ_OK)
+        return status;
+    if (memcmp(src, out, len)) {
+        printf("FAIL: streaming decompression differs.\n");
+        return 99;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+int main(void)
+{
+    int status = 0;
+    size_t len = N_PIXELS * 4;
+    size_t dest_len = len * 2;
+    unsigned char *src, *ref, *dest, *out;
+    struct aec_stream strm;
+    SZ_com_t params[] = {
+        {SZ_NN_OPTION_MASK | SZ_MSB_OPTION_MASK, 16, 16, 1000},
+        {SZ_NN_OPTION_MASK | SZ_LSB_OPTION_MASK, 24, 32, 4000},
+        {SZ_LSB_OPTION_MASK, 8, 8, 333},
+        {SZ_NN_OPTION_MASK | SZ_THREADS_OPTION_MASK, 16, 32, 64}
+    };
+    SZ_com_t planes = {SZ_NN_OPTION_MASK, 32, 16, 1000};
+
+    src = malloc(len);
+    ref = malloc(dest_len);
+    dest = malloc(dest_len);
+    out = malloc(len);
+    if (src == NULL || ref == NULL || dest == NULL || out == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    for (size_t k = 0; k < sizeof(params) / sizeof(params[0]); k++) {
+        SZ_com_t *param = &params[k];
+        size_t size = param->bits_per_pixel > 16 ? 4
+            : param->bits_per_pixel > 8 ? 2 : 1;
+        int msb = param->options_mask & SZ_MSB_OPTION_MASK;
+
+        /* Bytes above bits_per_pixel are zero */
+        for (size_t i = 0; i < N_PIXELS * size; i++) {
+            size_t j = msb ? size - 1 - i % size : i % size;
+            if (8 * j < (size_t)param->bits_per_pixel)
+                src[i] = (unsigned char)((i / 7)
+                                         ^ (i % 13 == 0 ? i >> 3 : 0));
+            else
+                src[i] = 0;
+        }
+
+        status = check(param, src, N_PIXELS * size, ref, dest, dest_len,
+                       out);
+        if (status)
+            goto DESTRUCT;
+    }
+
+    if (SZ_StreamCompressInit(&strm, &planes) != SZ_PARAM_ERROR
+        || SZ_StreamDecompressInit(&strm, &planes) != SZ_PARAM_ERROR) {
+        printf("FAIL: byte planes must be rejected.\n");
+        status = 99;
+    }
+
+DESTRUCT:
+    free(src);
+    free(ref);
+    free(dest);
+    free(out);
+    return status;
+}
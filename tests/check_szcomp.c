@@ -63,6 +63,47 @@ int main(int argc, char *argv[])
     if (memcmp(source, dest1, sourceLen) != 0)
         fprintf(stderr, "File %s Buffers differ\n", argv[2]);
 
+    /* Byte planes into a buffer larger than the data. Planes are
+     * only placed right once their length is known. */
+    memset(dest1, 0, sourceLen);
+    dest1Len = sourceLen + sourceLen / 10;
+    status = SZ_BufftoBuffDecompress(dest1, &dest1Len,
+                                     dest, destLen, &sz_param);
+    if (status != SZ_OK)
+        goto DESTRUCT;
+    if (dest1Len != sourceLen || memcmp(source, dest1, sourceLen) != 0) {
+        fprintf(stderr, "Decompression into larger buffer differs\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    /* Code again with the state cached by the first calls and after
+     * switching parameters */
+    for (int i = 0; i < 3; i++) {
+        size_t len = sourceLen + sourceLen / 10;
+
+        sz_param.bits_per_pixel = i == 1 ? 32 : 64;
+        status = SZ_BufftoBuffCompress(dest1, &len,
+                                       source, sourceLen, &sz_param);
+        if (status != SZ_OK)
+            goto DESTRUCT;
+        if (i != 1 && (len != destLen || memcmp(dest, dest1, len) != 0)) {
+            fprintf(stderr, "Cached compression differs\n");
+            status = 99;
+            goto DESTRUCT;
+        }
+    }
+    dest1Len = sourceLen;
+    status = SZ_BufftoBuffDecompress(dest1, &dest1Len,
+                                     dest, destLen, &sz_param);
+    if (status != SZ_OK)
+        goto DESTRUCT;
+    if (memcmp(source, dest1, sourceLen) != 0) {
+        fprintf(stderr, "Cached decompression differs\n");
+        status = 99;
+    }
+    SZ_release_cache();
+
 DESTRUCT:
     if (source)
         free(source);
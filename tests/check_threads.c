@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check_aec.h"
+
+#define N_SAMPLES (5 * 65536 + 777)
+#define THREADS 4
+#define WORDSIZE 4
+#define SCANLINE 1000
+
+struct config {
+    int bits_per_sample;
+    int flags;
+    int planes;
+};
+
+static size_t sample_size(int bits_per_sample)
+{
+    return bits_per_sample > 16 ? 4 : bits_per_sample > 8 ? 2 : 1;
+}
+
+static int setup(struct aec_stream *strm, const struct config *c,
+                 int encode, int threads)
+{
+    int status;
+
+    strm->bits_per_sample = c->bits_per_sample;
+    strm->flags = c->flags;
+    strm->block_size = 16;
+    strm->rsi = c->planes ? (SCANLINE + 15) / 16 : 64;
+
+    if (encode) {
+        status = aec_encode_init(strm);
+        if (status == AEC_OK && c->planes)
+            status = aec_encode_set_planes(strm, WORDSIZE,
+                                           N_SAMPLES / WORDSIZE);
+        if (status == AEC_OK && c->planes)
+            status = aec_encode_set_scanline(strm, SCANLINE, AEC_PAD_LAST);
+        if (status == AEC_OK)
+            status = aec_encode_set_threads(strm, threads);
+    } else {
+        status = aec_decode_init(strm);
+        if (status == AEC_OK && c->planes)
+            status = aec_decode_set_planes(strm, WORDSIZE,
+                                           N_SAMPLES / WORDSIZE);
+        if (status == AEC_OK && c->planes)
+            status = aec_decode_set_scanline(strm, SCANLINE);
+        if (status == AEC_OK)
+            status = aec_decode_set_threads(strm, threads);
+    }
+    return status;
+}
+
+static int encode(const struct config *c, int threads, size_t chunk,
+                  const unsigned char *src, size_t len,
+                  unsigned char *dest, size_t dest_len, size_t *out_len)
+{
+    struct aec_stream strm;
+    size_t fed = 0;
+    int status;
+
+    strm.next_in = src;
+    status = setup(&strm, c, 1, threads);
+    if (status != AEC_OK)
+        return status;
+
+    strm.avail_in = 0;
+    strm.next_out = dest;
+    strm.avail_out = dest_len;
+    while (fed < len) {
+        size_t n = len - fed < chunk ? len - fed : chunk;
+        strm.avail_in += n;
+        fed += n;
+        status = aec_encode(&strm, fed == len ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    *out_len = strm.total_out;
+    return aec_encode_end(&strm);
+}
+
+static int decode(const struct config *c, int threads, size_t chunk,
+                  const unsigned char *src, size_t src_len,
+                  unsigned char *dest, size_t len)
+{
+    struct aec_stream strm;
+    int status;
+
+    strm.next_out = dest;
+    status = setup(&strm, c, 0, threads);
+    if (status != AEC_OK)
+        return status;
+
+    strm.next_in = src;
+    strm.avail_in = src_len;
+    while (strm.total_out < len) {
+        size_t n = len - strm.total_out;
+        strm.avail_out = n < chunk ? n : chunk;
+        status = aec_decode(&strm, AEC_FLUSH);
+        if (status != AEC_OK)
+            return status;
+    }
+    return aec_decode_end(&strm);
+}
+
+static int check_config(const struct config *c, const unsigned char *src,
+                        unsigned char *cref, unsigned char *cbuf,
+                        size_t cbuf_len, unsigned char *obuf)
+{
+    size_t size = sample_size(c->bits_per_sample);
+    size_t len = N_SAMPLES * size;
+    size_t ref_len, out_len;
+    size_t chunks[] = {len, len / 3 + 5};
+    int status;
+
+    status = encode(c, 1, len, src, len, cref, cbuf_len, &ref_len);
+    if (status != AEC_OK)
+        return status;
+
+    for (int i = 0; i < 2; i++) {
+        status = encode(c, THREADS, chunks[i], src, len,
+                        cbuf, cbuf_len, &out_len);
+        if (status != AEC_OK)
+            return status;
+        if (out_len != ref_len || memcmp(cref, cbuf, ref_len)) {
+            printf("%s: threaded encoding differs from reference.\n",
+                   CHECK_FAIL);
+            return 99;
+        }
+
+        memset(obuf, 0, len);
+        /* Chunks of whole samples */
+        status = decode(c, THREADS, chunks[i] / size * size,
+                        cref, ref_len, obuf, len);
+        if (status != AEC_OK)
+            return status;
+        if (memcmp(src, obuf, len)) {
+            printf("%s: threaded decoding differs from input.\n",
+                   CHECK_FAIL);
+            return 99;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int status = 0;
+    unsigned char *src, *cref, *cbuf, *obuf;
+    size_t len = N_SAMPLES * 4;
+    size_t cbuf_len = len * 2;
+    struct config configs[] = {
+        {16, AEC_DATA_PREPROCESS, 0},
+        {32, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED, 0},
+        {24, AEC_DATA_PREPROCESS | AEC_DATA_MSB, 0},
+        {8, 0, 0},
+        {4, AEC_DATA_PREPROCESS | AEC_RESTRICTED, 0},
+        {8, AEC_DATA_PREPROCESS, 1}
+    };
+
+    src = malloc(len);
+    cref = malloc(cbuf_len);
+    cbuf = malloc(cbuf_len);
+    obuf = malloc(len);
+    if (src == NULL || cref == NULL || cbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        status = 99;
+        goto DESTRUCT;
+    }
+
+    for (size_t k = 0; k < sizeof(configs) / sizeof(configs[0]); k++) {
+        struct config *c = &configs[k];
+        size_t size = sample_size(c->bits_per_sample);
+        uint32_t mask = UINT32_MAX >> (32 - c->bits_per_sample);
+
+        /* Smooth stretches, noise and runs of zeros */
+        for (size_t i = 0; i < N_SAMPLES; i++) {
+            uint32_t x;
+            if ((i / 5000) % 7 == 3)
+                x = 0;
+            else if ((i / 5000) % 7 == 5)
+                x = (uint32_t)(i * 2654435761u >> 7);
+            else
+                x = (uint32_t)(i / 3 + (i % 29) * (i % 3));
+            x &= mask;
+            for (size_t j = 0; j < size; j++) {
+                size_t b = c->flags & AEC_DATA_MSB ? size - 1 - j : j;
+                src[i * size + b] = (unsigned char)(x >> (8 * j));
+            }
+        }
+
+        printf("Checking %i threads with %2i bit, flags %3i%s ... ",
+               THREADS, c->bits_per_sample, c->flags,
+               c->planes ? ", planes" : "");
+        status = check_config(c, src, cref, cbuf, cbuf_len, obuf);
+        if (status)
+            goto DESTRUCT;
+        printf("%s\n", CHECK_PASS);
+    }
+
+DESTRUCT:
+    free(src);
+    free(cref);
+    free(cbuf);
+    free(obuf);
+    return status;
+}